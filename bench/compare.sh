@@ -0,0 +1,85 @@
+#!/bin/sh
+# times each phase of the workload for every binary, relative to the first
+# usage: bench/compare.sh BASELINE [BINARY...]
+set -e
+
+. "$(dirname "$0")/fixture.sh"
+
+RUNS=${RUNS:-5}
+ALIASES=${ALIASES:-5000}
+TUPLES=${TUPLES:-200000}
+EDITS=${EDITS:-100}
+
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+now_ms()
+{
+	echo $(($(date +%s%N) / 1000000))
+}
+
+write_lal $ALIASES > "$DIR/lal"
+write_tuples $TUPLES > "$DIR/tuples"
+
+phase()
+{
+	case $1 in
+		parse)
+			i=0
+			while [ $i -lt $EDITS ]
+			do
+				"$LAL" --expand a$((i * 7 % ALIASES)) < /dev/null
+				i=$((i + 1))
+			done
+			;;
+		expand)
+			"$LAL" --expand a1 -q < "$DIR/tuples" > /dev/null
+			;;
+		edit)
+			i=0
+			while [ $i -lt $EDITS ]
+			do
+				"$LAL" --append n$i "echo <<0>>" > /dev/null
+				"$LAL" --delete n$i > /dev/null
+				i=$((i + 1))
+			done
+			;;
+	esac
+}
+
+# median of RUNS timings, in ms
+measure()
+{
+	r=0
+	while [ $r -lt $RUNS ]
+	do
+		cp "$DIR/lal" "$DIR/run/.lal"
+		start=$(now_ms)
+		(cd "$DIR/run" && phase $1)
+		echo $(($(now_ms) - start))
+		r=$((r + 1))
+	done | sort -n | sed -n "$(((RUNS + 1) / 2))p"
+}
+
+mkdir "$DIR/run"
+printf '%-24s %10s %10s %10s %10s %10s\n' BINARY SIZE PARSE EXPAND EDIT SPEEDUP
+
+for BIN in "$@"
+do
+	LAL=$(cd "$(dirname "$BIN")" && pwd)/$(basename "$BIN")
+
+	parse=$(measure parse)
+	expand=$(measure expand)
+	edit=$(measure edit)
+	total=$((parse + expand + edit))
+
+	if [ -z "$base" ]
+	then
+		base=$total
+	fi
+
+	size=$(wc -c < "$LAL")
+	speedup=$(awk -v b=$base -v t=$total 'BEGIN { printf "%.2fx", (t > 0 ? b / t : 0) }')
+
+	printf '%-24s %10s %8sms %8sms %8sms %10s\n' "$(basename "$BIN")" $size $parse $expand $edit $speedup
+done
@@ -0,0 +1,489 @@
+// times whole alias invocations under each way of running them, for aliases of 1 to 100 trivial lines
+// usage: bench/exec_bench [-n RUNS] [-w WARMUP] [-l 1,10,100] [-a FILLER] [-e CMD] [-c CPU] [-C] LALIAS
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sched.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define MAX_LINE_COUNTS 16
+#define SCRIPT_SIZE (1 << 16)
+
+extern char **environ;
+
+enum strategy
+{
+	STRATEGY_SH,
+	STRATEGY_PLAIN,
+	STRATEGY_SORTED,
+	STRATEGY_COMPILED,
+	STRATEGY_FUNCTION,
+	N_STRATEGIES
+};
+
+static const char *const strategy_names[] = { "sh", "plain", "sorted", "compiled", "function" };
+
+struct options
+{
+	int runs;
+	int warmup;
+	int line_counts[MAX_LINE_COUNTS];
+	int n_line_counts;
+	int filler;
+	const char *cmd;
+	int cpu; // -1 to leave scheduling alone
+	int cold;
+	char lalias[PATH_MAX];
+};
+
+static int64_t now_us(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return (int64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+static void die(const char *what)
+{
+	fprintf(stderr, "exec_bench: %s: %s\n", what, strerror(errno));
+	exit(1);
+}
+
+static int compare_us(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a;
+	int64_t y = *(const int64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int64_t percentile(int64_t *sorted, int n, double p)
+{
+	int k = (int)(p * (n - 1) + 0.5);
+
+	return sorted[k];
+}
+
+// runs argv with stdout and stderr on /dev/null, returning its wall time or -1
+static int64_t run_quiet(char *const argv[])
+{
+	posix_spawn_file_actions_t actions;
+	pid_t pid;
+	int status;
+
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+	posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+
+	int64_t start = now_us();
+
+	if(posix_spawn(&pid, argv[0], &actions, NULL, argv, environ) != 0)
+	{
+		posix_spawn_file_actions_destroy(&actions);
+
+		return -1;
+	}
+
+	while(waitpid(pid, &status, 0) < 0)
+	{
+		if(errno != EINTR)
+		{
+			return -1;
+		}
+	}
+
+	int64_t end = now_us();
+
+	posix_spawn_file_actions_destroy(&actions);
+
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? end - start : -1;
+}
+
+static void must_run(char *const argv[])
+{
+	if(run_quiet(argv) < 0)
+	{
+		fprintf(stderr, "exec_bench: %s %s failed\n", argv[0], argv[1] ? argv[1] : "");
+		exit(1);
+	}
+}
+
+// dirty pages survive DONTNEED, so they are written back first
+static void drop_cache(const char *path)
+{
+	int fd = open(path, O_RDONLY);
+
+	if(fd < 0)
+	{
+		return;
+	}
+
+	fdatasync(fd);
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	close(fd);
+}
+
+static void drop_caches(struct options *opts, const char *name)
+{
+	char script[PATH_MAX];
+
+	snprintf(script, sizeof(script), ".lal_cache/%s.sh", name);
+
+	drop_cache(opts->lalias);
+	drop_cache(".lal");
+	drop_cache(".lal_cache/stamp");
+	drop_cache(script);
+	drop_cache("/bin/sh");
+}
+
+static void write_lal(struct options *opts)
+{
+	FILE *lal = fopen(".lal", "w");
+
+	if(!lal)
+	{
+		die(".lal");
+	}
+
+	// filler so the parse and lookup cost something like a real .lal
+	for(int k = 0; k < opts->filler; k++)
+	{
+		fprintf(lal, "filler%d:{echo <<0>> <<1>>}{: build <<0>> --jobs 4 && : test <<1>>}<<END>>\n", k);
+	}
+
+	for(int c = 0; c < opts->n_line_counts; c++)
+	{
+		fprintf(lal, "bench%d:", opts->line_counts[c]);
+
+		for(int l = 0; l < opts->line_counts[c]; l++)
+		{
+			fprintf(lal, "{%s}", opts->cmd);
+		}
+
+		fprintf(lal, "<<END>>\n");
+	}
+
+	if(fclose(lal) != 0)
+	{
+		die(".lal");
+	}
+}
+
+// puts the directory in the state the strategy runs from
+static void prepare(struct options *opts, enum strategy strategy)
+{
+	char *rm_cache[] = { "/bin/rm", "-rf", ".lal_cache", ".lal_stats", NULL };
+	char *sort[] = { opts->lalias, "--sort", NULL };
+	char *compile[] = { opts->lalias, "--compile", NULL };
+
+	write_lal(opts);
+	must_run(rm_cache);
+
+	if(strategy == STRATEGY_SORTED)
+	{
+		must_run(sort);
+	}
+	else if(strategy == STRATEGY_COMPILED)
+	{
+		must_run(compile);
+	}
+}
+
+static void print_row(const char *strategy, int lines, const char *cache, int64_t *us, int n)
+{
+	qsort(us, n, sizeof(int64_t), compare_us);
+
+	printf("%-9s %6d  %-4s %6d %8lld %8lld %8lld %8lld %8lld\n", strategy, lines, cache, n,
+		(long long)us[0], (long long)percentile(us, n, 0.50), (long long)percentile(us, n, 0.90), (long long)percentile(us, n, 0.99), (long long)us[n - 1]);
+}
+
+// the spawned strategies, each run its own process
+static int64_t measure_spawned(struct options *opts, enum strategy strategy, int lines, int64_t *us)
+{
+	char name[32];
+	char script[SCRIPT_SIZE] = "";
+
+	snprintf(name, sizeof(name), "bench%d", lines);
+
+	// the floor: one shell running every line, with no lalias at all
+	for(int l = 0; strategy == STRATEGY_SH && l < lines; l++)
+	{
+		strncat(script, opts->cmd, sizeof(script) - strlen(script) - 2);
+		strcat(script, "\n");
+	}
+
+	char *sh[] = { "/bin/sh", "-c", script, NULL };
+	char *alias[] = { opts->lalias, name, NULL };
+	char *const *argv = strategy == STRATEGY_SH ? sh : alias;
+
+	for(int w = 0; w < opts->warmup; w++)
+	{
+		run_quiet(argv);
+	}
+
+	// so --stats only shows the measured runs
+	unlink(".lal_stats");
+
+	for(int r = 0; r < opts->runs; r++)
+	{
+		if(opts->cold)
+		{
+			drop_caches(opts, name);
+		}
+
+		us[r] = run_quiet(argv);
+
+		if(us[r] < 0)
+		{
+			fprintf(stderr, "exec_bench: %s %s failed\n", strategy_names[strategy], name);
+			exit(1);
+		}
+	}
+
+	print_row(strategy_names[strategy], lines, opts->cold ? "cold" : "warm", us, opts->runs);
+
+	return percentile(us, opts->runs, 0.50);
+}
+
+// an exported function has no process of its own, so one bash times every call with $EPOCHREALTIME
+static int64_t measure_function(struct options *opts, int lines, int64_t *us)
+{
+	char script[SCRIPT_SIZE];
+
+	snprintf(script, sizeof(script),
+		"eval \"$('%s' --export bash)\" || exit 1\n"
+		"i=0; while [ $i -lt %d ]; do bench%d >/dev/null 2>&1; i=$((i + 1)); done\n"
+		"i=0; while [ $i -lt %d ]; do s=$EPOCHREALTIME; bench%d >/dev/null 2>&1; e=$EPOCHREALTIME; echo \"$s $e\"; i=$((i + 1)); done\n",
+		opts->lalias, opts->warmup, lines, opts->runs, lines);
+
+	setenv("LC_ALL", "C", 1);
+
+	FILE *bash = fopen("function.sh", "w");
+
+	if(!bash || fputs(script, bash) == EOF || fclose(bash) != 0)
+	{
+		die("function.sh");
+	}
+
+	FILE *times = popen("bash function.sh", "r");
+	int n = 0;
+	double start, end;
+
+	while(times && n < opts->runs && fscanf(times, "%lf %lf", &start, &end) == 2)
+	{
+		us[n++] = (int64_t)((end - start) * 1e6 + 0.5);
+	}
+
+	if(!times || pclose(times) != 0 || n != opts->runs)
+	{
+		fprintf(stderr, "exec_bench: function bench%d failed\n", lines);
+		exit(1);
+	}
+
+	// in-process, there is nothing to evict between calls
+	print_row("function", lines, "warm", us, n);
+
+	return percentile(us, n, 0.50);
+}
+
+static int have_function_strategy(void)
+{
+	char *check[] = { "/bin/sh", "-c", "command -v bash && bash -c '[ -n \"$EPOCHREALTIME\" ]'", NULL };
+
+	return run_quiet(check) >= 0;
+}
+
+static void print_line_stats(struct options *opts, int lines)
+{
+	char name[32];
+	char command[PATH_MAX + 64];
+
+	snprintf(name, sizeof(name), "bench%d", lines);
+	snprintf(command, sizeof(command), "'%s' --stats %s", opts->lalias, name);
+
+	fflush(stdout);
+
+	if(system(command) != 0)
+	{
+		fprintf(stderr, "exec_bench: no per-line stats for %s\n", name);
+	}
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: exec_bench [-n RUNS] [-w WARMUP] [-l 1,10,100] [-a FILLER] [-e CMD] [-c CPU] [-C] LALIAS\n");
+	exit(2);
+}
+
+static void parse_options(int argc, char *argv[], struct options *opts)
+{
+	const char *counts = "1,10,100";
+	int opt;
+
+	opts->runs = 200;
+	opts->warmup = 10;
+	opts->filler = 200;
+	opts->cmd = ":";
+	opts->cpu = -1;
+	opts->cold = 0;
+
+	while((opt = getopt(argc, argv, "n:w:l:a:e:c:C")) != -1)
+	{
+		switch (opt)
+		{
+			case 'n':
+				opts->runs = atoi(optarg);
+				break;
+			case 'w':
+				opts->warmup = atoi(optarg);
+				break;
+			case 'l':
+				counts = optarg;
+				break;
+			case 'a':
+				opts->filler = atoi(optarg);
+				break;
+			case 'e':
+				opts->cmd = optarg;
+				break;
+			case 'c':
+				opts->cpu = atoi(optarg);
+				break;
+			case 'C':
+				opts->cold = 1;
+				break;
+			default:
+				usage();
+		}
+	}
+
+	if(optind != argc - 1 || opts->runs < 1 || opts->warmup < 0 || opts->filler < 0)
+	{
+		usage();
+	}
+
+	if(!realpath(argv[optind], opts->lalias))
+	{
+		die(argv[optind]);
+	}
+
+	opts->n_line_counts = 0;
+
+	for(const char *c = counts; *c && opts->n_line_counts < MAX_LINE_COUNTS; c = strchr(c, ',') ? strchr(c, ',') + 1 : c + strlen(c))
+	{
+		int lines = atoi(c);
+
+		if(lines < 1 || lines > 1000)
+		{
+			usage();
+		}
+
+		opts->line_counts[opts->n_line_counts++] = lines;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	struct options opts;
+
+	parse_options(argc, argv, &opts);
+
+	// children inherit the mask, so the whole invocation stays on one cpu
+	if(opts.cpu >= 0)
+	{
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+		CPU_SET(opts.cpu, &set);
+
+		if(sched_setaffinity(0, sizeof(set), &set) != 0)
+		{
+			die("sched_setaffinity");
+		}
+	}
+
+	char dir[] = "/tmp/exec_bench.XXXXXX";
+
+	if(!mkdtemp(dir) || chdir(dir) != 0)
+	{
+		die("mkdtemp");
+	}
+
+	int64_t *us = malloc(sizeof(int64_t) * opts.runs);
+
+	if(!us)
+	{
+		die("malloc");
+	}
+
+	int function = have_function_strategy();
+
+	printf("# %s, %d runs after %d warmup, %d filler aliases, line \"%s\", cpu %d\n", opts.lalias, opts.runs, opts.warmup, opts.filler, opts.cmd, opts.cpu);
+	printf("%-9s %6s  %-4s %6s %8s %8s %8s %8s %8s\n", "strategy", "lines", "page", "runs", "min_us", "p50_us", "p90_us", "p99_us", "max_us");
+
+	int64_t p50s[N_STRATEGIES][MAX_LINE_COUNTS];
+	int per_line = opts.n_line_counts - 1;
+
+	// the smallest alias with more than one line keeps the per-line table short
+	for(int c = opts.n_line_counts - 1; c >= 0; c--)
+	{
+		per_line = opts.line_counts[c] > 1 && opts.line_counts[c] < opts.line_counts[per_line] ? c : per_line;
+	}
+
+	for(int s = 0; s < N_STRATEGIES; s++)
+	{
+		if(s == STRATEGY_FUNCTION && !function)
+		{
+			printf("%-9s skipped, needs bash 5 for $EPOCHREALTIME\n", strategy_names[s]);
+			continue;
+		}
+
+		prepare(&opts, s);
+
+		for(int c = 0; c < opts.n_line_counts; c++)
+		{
+			p50s[s][c] = s == STRATEGY_FUNCTION ? measure_function(&opts, opts.line_counts[c], us) : measure_spawned(&opts, s, opts.line_counts[c], us);
+
+			// lalias keeps its own per-line histograms, which separate the per-line cost from startup
+			if(s == STRATEGY_PLAIN && c == per_line)
+			{
+				print_line_stats(&opts, opts.line_counts[c]);
+			}
+		}
+	}
+
+	// the slope between the smallest and largest alias is the marginal cost of one more line
+	int first = 0, last = opts.n_line_counts - 1;
+
+	for(int s = 0; last > first && s < N_STRATEGIES; s++)
+	{
+		if(s == STRATEGY_FUNCTION && !function)
+		{
+			continue;
+		}
+
+		int64_t span = opts.line_counts[last] - opts.line_counts[first];
+
+		printf("%-9s per line %.1fus, fixed %lldus\n", strategy_names[s], (double)(p50s[s][last] - p50s[s][first]) / span,
+			(long long)(p50s[s][first] - (p50s[s][last] - p50s[s][first]) * opts.line_counts[first] / span));
+	}
+
+	char *rm_dir[] = { "/bin/rm", "-rf", dir, NULL };
+
+	chdir("/");
+	run_quiet(rm_dir);
+	free(us);
+
+	return 0;
+}
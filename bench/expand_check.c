@@ -0,0 +1,147 @@
+// lal_expand against lalias --expand on aliases with directive-only, directive and guarded lines; the output must match
+// usage: bench/expand_check BINARY
+#define _GNU_SOURCE
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../liblalias.h"
+
+static const char *lal =
+	"directives:{<<@timeout 5>>}{echo one <<0>>}{  <<@mem 64M>>  }{<<@cpu 2>>echo two <<0>>}<<END>>\n"
+	"guarded:{<<?env HOME>>echo home <<0>>}{<<?!exists /nonexistent>>echo missing}{<<?ok>>echo after}<<END>>\n"
+	"mixed:{<<@timeout 1>>}{<<?fail>><<@grace 2>>echo <<0>> <<1>>}{<<@nofile 64>>}<<END>>\n";
+
+static const char *aliases[] = { "directives", "guarded", "mixed" };
+
+static void die(const char *what)
+{
+	fprintf(stderr, "expand_check: %s\n", what);
+	exit(1);
+}
+
+// every expanded line followed by a newline, as --expand writes them
+static char *library_expand(lal_handle *handle, const char *name)
+{
+	const char *argv[] = { "a", "b c" };
+	char **lines;
+	int n_lines;
+	enum error_code e = lal_expand(handle, name, 2, argv, &lines, &n_lines);
+
+	if(e != ERROR_NONE)
+	{
+		die(lal_strerror(e));
+	}
+
+	char *text = NULL;
+	size_t size = 0;
+	FILE *out = open_memstream(&text, &size);
+
+	for(int l = 0; l < n_lines; l++)
+	{
+		fprintf(out, "%s\n", lines[l]);
+	}
+
+	fclose(out);
+	lal_free_lines(lines, n_lines);
+
+	return text;
+}
+
+static char *cli_expand(const char *binary, const char *name)
+{
+	char command[PATH_MAX + 64];
+
+	snprintf(command, sizeof(command), "printf 'a\\tb c\\n' | '%s' --expand %s", binary, name);
+
+	FILE *pipe = popen(command, "r");
+
+	if(!pipe)
+	{
+		die("popen");
+	}
+
+	char *text = NULL;
+	size_t size = 0;
+	FILE *out = open_memstream(&text, &size);
+	char buf[4096];
+	size_t n;
+
+	while((n = fread(buf, 1, sizeof(buf), pipe)) > 0)
+	{
+		fwrite(buf, 1, n, out);
+	}
+
+	fclose(out);
+
+	if(pclose(pipe) != 0)
+	{
+		die("lalias --expand failed");
+	}
+
+	return text;
+}
+
+int main(int argc, char *argv[])
+{
+	char binary[PATH_MAX];
+
+	if(argc != 2 || !realpath(argv[1], binary))
+	{
+		fprintf(stderr, "usage: expand_check BINARY\n");
+		return 2;
+	}
+
+	char dir[] = "/tmp/expand_check.XXXXXX";
+
+	if(!mkdtemp(dir) || chdir(dir) != 0)
+	{
+		die("mkdtemp");
+	}
+
+	FILE *file = fopen(".lal", "w");
+
+	if(!file || fputs(lal, file) == EOF || fclose(file) != 0)
+	{
+		die(".lal");
+	}
+
+	lal_handle *handle;
+
+	if(lal_load(&handle, ".lal") != ERROR_NONE)
+	{
+		die("lal_load");
+	}
+
+	int failed = 0;
+
+	for(size_t k = 0; k < sizeof(aliases) / sizeof(aliases[0]); k++)
+	{
+		char *library = library_expand(handle, aliases[k]);
+		char *cli = cli_expand(binary, aliases[k]);
+
+		if(strcmp(library, cli) != 0)
+		{
+			printf("expand_check: %s differs\n--- lal_expand\n%s--- lalias --expand\n%s", aliases[k], library, cli);
+			failed = 1;
+		}
+
+		free(library);
+		free(cli);
+	}
+
+	lal_destroy(handle);
+	unlink(".lal");
+	chdir("/");
+	rmdir(dir);
+
+	if(!failed)
+	{
+		printf("expand_check: lal_expand matches lalias --expand\n");
+	}
+
+	return failed;
+}
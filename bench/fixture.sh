@@ -0,0 +1,19 @@
+# the .lal and tuples the bench scripts share, sourced rather than run
+# usage: . bench/fixture.sh; write_lal N > .lal; write_tuples N > tuples
+
+# N small aliases, written directly so the build is quick
+write_lal()
+{
+	i=0
+	while [ $i -lt $1 ]
+	do
+		printf 'a%d:{echo <<0>> <<1>>}{printf "%%s\\n" <<1>>}{: build <<0>> --jobs 4 && : test <<1>>}<<END>>\n' $i
+		i=$((i + 1))
+	done
+}
+
+# N tab-separated argument tuples for --expand
+write_tuples()
+{
+	seq 1 $1 | awk '{ printf "%s\targ %s\n", $1, $1 }'
+}
@@ -0,0 +1,50 @@
+#!/bin/sh
+# runs every command under --mem-report and fails if any of them exits with memory still allocated
+# usage: bench/leakcheck.sh BINARY, ideally one built with -fsanitize=address so leaks of lost pointers are caught too
+set -e
+
+. "$(dirname "$0")/fixture.sh"
+
+LAL=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+cd "$DIR"
+
+write_lal 200 > .lal
+write_tuples 1000 > tuples
+
+failed=0
+
+check()
+{
+	if ! "$LAL" --mem-report "$@" < tuples > /dev/null 2> report
+	then
+		cat report
+		echo "leakcheck: lalias $* failed"
+		failed=1
+	elif ! awk '$1 == "total" { live = $6 } END { exit live != 0 }' report
+	then
+		cat report
+		echo "leakcheck: lalias $* exited with memory still allocated"
+		failed=1
+	fi
+}
+
+check a1 x y
+check --expand a2
+check --expand a3 -q
+check --append n1 "echo <<0>>" "true"
+check --truncate n1 1
+check --rename n1 m1
+check --delete m1
+check --stats
+check --sort
+check a4 x y
+check --unsort
+check --export bash
+check --compile
+check a5 x y
+check --index
+check --find a6
+
+[ $failed -eq 0 ] && echo "leakcheck: no memory left allocated at exit"
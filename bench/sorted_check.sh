@@ -0,0 +1,68 @@
+#!/bin/sh
+# a sorted .lal must resolve every alias as its unsorted copy does, however the records are spaced, and fail with the full parse's error when damaged
+# usage: bench/sorted_check.sh BINARY
+set -e
+
+LAL=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+cd "$DIR"
+
+failed=0
+
+i=0
+while [ $i -lt 64 ]
+do
+	printf 'a%d:{echo %d <<0>>}<<END>>\n' $i $i
+	i=$((i + 1))
+done > unsorted
+cp unsorted .lal
+"$LAL" --sort > /dev/null
+
+# the parser skips any run of spaces and newlines after <<END>>
+sed '2,$ s/<<END>>$/<<END>>   \n/' .lal > padded
+
+for name in a0 a1 a9 a10 a32 a63
+do
+	cp unsorted .lal
+	want=$("$LAL" $name x)
+	cp padded .lal
+	got=$("$LAL" $name x 2>&1) || true
+	if [ "$got" != "$want" ]
+	then
+		echo "sorted-check: $name printed '$got' from a padded sorted .lal, expected '$want'"
+		failed=1
+	fi
+done
+
+cp padded .lal
+if "$LAL" zz > /dev/null 2> err || ! grep -q "not found" err
+then
+	echo "sorted-check: a missing alias was not reported as not found"
+	failed=1
+fi
+
+# CRLF records are a parse error, and the sorted path must say so rather than report the alias missing
+{ head -n 1 padded; sed '1d; s/$/\r/' padded; } > .lal
+sed '1d' .lal > crlf
+for name in a0 a10 a63
+do
+	if "$LAL" $name x > /dev/null 2> err || grep -q "not found" err
+	then
+		cat err
+		echo "sorted-check: $name in a CRLF sorted .lal did not fail with a parse error"
+		failed=1
+	fi
+done
+cp .lal crlf-sorted
+cp crlf .lal
+"$LAL" a0 x > /dev/null 2> unsorted-err || true
+cp crlf-sorted .lal
+"$LAL" a0 x > /dev/null 2> sorted-err || true
+if [ "$(sed 's/ (.*//' sorted-err)" != "$(sed 's/ (.*//' unsorted-err)" ]
+then
+	echo "sorted-check: a CRLF sorted .lal failed with '$(cat sorted-err)', the full parse with '$(cat unsorted-err)'"
+	failed=1
+fi
+
+[ $failed -eq 0 ] && echo "sorted-check: sorted and unsorted lookups agree"
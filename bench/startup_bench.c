@@ -0,0 +1,286 @@
+// startup cost of each lalias binary: exec to its first syscall, exec to opening .lal, and a whole `lalias NAME`
+// usage: bench/startup_bench [-n RUNS] BINARY...
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdint.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define ALIAS "startup"
+
+// older glibc lacks these and <linux/ptrace.h> clashes with <sys/ptrace.h>, so the kernel ABI is spelled out
+#define GET_SYSCALL_INFO 0x420e
+#define SYSCALL_INFO_ENTRY 1
+
+struct syscall_entry_info
+{
+	uint8_t op;
+	uint8_t pad[3];
+	uint32_t arch;
+	uint64_t instruction_pointer;
+	uint64_t stack_pointer;
+	uint64_t nr;
+	uint64_t args[6];
+};
+
+extern char **environ;
+
+static int64_t now_ns(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return (int64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static void die(const char *what)
+{
+	fprintf(stderr, "startup_bench: %s: %s\n", what, strerror(errno));
+	exit(1);
+}
+
+static int compare_ns(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a;
+	int64_t y = *(const int64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void print_row(const char *binary, const char *what, int64_t *ns, int n)
+{
+	qsort(ns, n, sizeof(int64_t), compare_ns);
+
+	printf("%-24s %-14s %9.1f %9.1f %9.1f %9.1f\n", binary, what, ns[0] / 1e3, ns[n / 2] / 1e3, ns[(int)(n * 0.9)] / 1e3, ns[n - 1] / 1e3);
+}
+
+// whether the path argument the tracee passed at addr is ".lal"
+static int is_lal_path(pid_t pid, unsigned long long addr)
+{
+	union
+	{
+		long word;
+		char bytes[sizeof(long)];
+	} chunk;
+	char path[sizeof(".lal")];
+
+	for(int k = 0; k < sizeof(path); k += sizeof(long))
+	{
+		errno = 0;
+		chunk.word = ptrace(PTRACE_PEEKDATA, pid, (void *)(addr + k), NULL);
+
+		if(errno != 0)
+		{
+			return 0;
+		}
+
+		memcpy(path + k, chunk.bytes, sizeof(path) - k < sizeof(long) ? sizeof(path) - k : sizeof(long));
+	}
+
+	return memcmp(path, ".lal", sizeof(path)) == 0;
+}
+
+// ptrace stops add their own cost to both numbers, but the same to every binary
+static int trace_startup(const char *binary, int64_t *first_syscall, int64_t *lal_open)
+{
+	pid_t pid = fork();
+
+	if(pid == 0)
+	{
+		int null = open("/dev/null", O_WRONLY);
+
+		dup2(null, STDOUT_FILENO);
+		dup2(null, STDERR_FILENO);
+		ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+		raise(SIGSTOP);
+		execl(binary, binary, ALIAS, (char *)NULL);
+		_exit(127);
+	}
+
+	int status;
+
+	if(pid < 0 || waitpid(pid, &status, 0) != pid || !WIFSTOPPED(status))
+	{
+		return 0;
+	}
+
+	ptrace(PTRACE_SETOPTIONS, pid, NULL, (void *)(PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACEEXEC | PTRACE_O_EXITKILL));
+	ptrace(PTRACE_CONT, pid, NULL, NULL);
+
+	int64_t exec_done = 0;
+
+	*first_syscall = -1;
+	*lal_open = -1;
+
+	while(waitpid(pid, &status, 0) == pid && WIFSTOPPED(status))
+	{
+		if(status >> 8 == (SIGTRAP | (PTRACE_EVENT_EXEC << 8)))
+		{
+			exec_done = now_ns();
+		}
+		else if(exec_done && WSTOPSIG(status) == (SIGTRAP | 0x80))
+		{
+			struct syscall_entry_info info;
+			int64_t t = now_ns();
+
+			// execve's own exit stop comes first and is not an entry
+			if(ptrace(GET_SYSCALL_INFO, pid, (void *)sizeof(info), &info) > 0 && info.op == SYSCALL_INFO_ENTRY)
+			{
+				if(*first_syscall < 0)
+				{
+					*first_syscall = t - exec_done;
+				}
+
+				if(info.nr == SYS_openat && is_lal_path(pid, info.args[1]))
+				{
+					*lal_open = t - exec_done;
+					ptrace(PTRACE_DETACH, pid, NULL, NULL);
+					break;
+				}
+			}
+		}
+
+		ptrace(exec_done ? PTRACE_SYSCALL : PTRACE_CONT, pid, NULL, NULL);
+	}
+
+	while(waitpid(pid, &status, 0) < 0 && errno == EINTR)
+	{
+	}
+
+	return *first_syscall >= 0 && *lal_open >= 0;
+}
+
+static int64_t run_alias(const char *binary)
+{
+	posix_spawn_file_actions_t actions;
+	char *argv[] = { (char *)binary, ALIAS, NULL };
+	pid_t pid;
+	int status;
+
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+
+	int64_t start = now_ns();
+
+	if(posix_spawn(&pid, binary, &actions, NULL, argv, environ) != 0 || waitpid(pid, &status, 0) != pid)
+	{
+		posix_spawn_file_actions_destroy(&actions);
+
+		return -1;
+	}
+
+	int64_t end = now_ns();
+
+	posix_spawn_file_actions_destroy(&actions);
+
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? end - start : -1;
+}
+
+int main(int argc, char *argv[])
+{
+	int runs = 200;
+	int opt;
+
+	while((opt = getopt(argc, argv, "n:")) != -1)
+	{
+		if(opt != 'n' || (runs = atoi(optarg)) < 1)
+		{
+			fprintf(stderr, "usage: startup_bench [-n RUNS] BINARY...\n");
+			return 2;
+		}
+	}
+
+	if(optind == argc)
+	{
+		fprintf(stderr, "usage: startup_bench [-n RUNS] BINARY...\n");
+		return 2;
+	}
+
+	int n_binaries = argc - optind;
+	char (*binaries)[PATH_MAX] = malloc(sizeof(*binaries) * n_binaries);
+	int64_t *first = malloc(sizeof(int64_t) * runs);
+	int64_t *lal = malloc(sizeof(int64_t) * runs);
+	int64_t *whole = malloc(sizeof(int64_t) * runs);
+
+	if(!binaries || !first || !lal || !whole)
+	{
+		die("malloc");
+	}
+
+	for(int b = 0; b < n_binaries; b++)
+	{
+		if(!realpath(argv[optind + b], binaries[b]))
+		{
+			die(argv[optind + b]);
+		}
+	}
+
+	char dir[] = "/tmp/startup_bench.XXXXXX";
+
+	if(!mkdtemp(dir) || chdir(dir) != 0)
+	{
+		die("mkdtemp");
+	}
+
+	// an echo runs in-process, so the whole run is lalias and no shell
+	FILE *file = fopen(".lal", "w");
+
+	if(!file || fputs(ALIAS ":{echo ok}<<END>>\n", file) == EOF || fclose(file) != 0)
+	{
+		die(".lal");
+	}
+
+	printf("# %d runs each, times in us\n", runs);
+	printf("%-24s %-14s %9s %9s %9s %9s\n", "binary", "measure", "min", "p50", "p90", "max");
+
+	for(int b = 0; b < n_binaries; b++)
+	{
+		const char *name = strrchr(binaries[b], '/') + 1;
+
+		for(int r = 0; r < runs; r++)
+		{
+			if(!trace_startup(binaries[b], &first[r], &lal[r]))
+			{
+				fprintf(stderr, "startup_bench: could not trace %s, is ptrace allowed?\n", name);
+				return 1;
+			}
+		}
+
+		for(int r = 0; r < runs; r++)
+		{
+			if((whole[r] = run_alias(binaries[b])) < 0)
+			{
+				fprintf(stderr, "startup_bench: %s " ALIAS " failed\n", name);
+				return 1;
+			}
+		}
+
+		print_row(name, "first syscall", first, runs);
+		print_row(name, "open .lal", lal, runs);
+		print_row(name, "whole run", whole, runs);
+	}
+
+	unlink(".lal");
+	unlink(".lal_stats");
+	chdir("/");
+	rmdir(dir);
+
+	free(binaries);
+	free(first);
+	free(lal);
+	free(whole);
+
+	return 0;
+}
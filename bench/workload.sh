@@ -0,0 +1,52 @@
+#!/bin/sh
+# representative lalias workload: parse, lookup, expand and edit
+# usage: bench/workload.sh BINARY [SCALE]
+set -e
+
+. "$(dirname "$0")/fixture.sh"
+
+LAL=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+SCALE=${2:-1}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+cd "$DIR"
+
+ALIASES=$((500 * SCALE))
+TUPLES=$((20000 * SCALE))
+EDITS=$((50 * SCALE))
+
+write_lal $ALIASES > .lal
+
+# parse and lookup, the start of every invocation
+i=0
+while [ $i -lt $EDITS ]
+do
+	"$LAL" --expand a$((i * 7 % ALIASES)) < /dev/null
+	i=$((i + 1))
+done
+
+# expand
+write_tuples $TUPLES > tuples
+"$LAL" --expand a1 < tuples > /dev/null
+"$LAL" --expand a2 -q < tuples > /dev/null
+
+# run, which also records stats
+i=0
+while [ $i -lt $EDITS ]
+do
+	"$LAL" a$i x y > /dev/null
+	i=$((i + 1))
+done
+
+"$LAL" --stats > /dev/null
+
+# edit
+i=0
+while [ $i -lt $EDITS ]
+do
+	"$LAL" --append n$i "echo <<0>>" "true" > /dev/null
+	"$LAL" --truncate n$i 1 > /dev/null
+	"$LAL" --rename n$i m$i > /dev/null
+	"$LAL" --delete m$i > /dev/null
+	i=$((i + 1))
+done
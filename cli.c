@@ -0,0 +1,738 @@
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lalias.h"
+#include "lal_alloc.h"
+#include "index.h"
+#include "stats.h"
+#include "shell.h"
+
+void lal_error(enum error_code code)
+{
+	off_t offset;
+	off_t line;
+
+	if(lal_error_position(&offset, &line))
+	{
+		fprintf(stderr, "ERROR: %s (.lal line %lld, offset %lld)\n", lal_strerror(code), (long long)line, (long long)offset);
+	}
+	else 
+	{
+		fprintf(stderr, "ERROR: %s\n", lal_strerror(code));
+	}
+
+	exit(1);
+}
+
+void lal_check(enum error_code code)
+{
+	if(code != ERROR_NONE)
+	{
+		lal_error(code);
+	}
+}
+
+void print_arg_v(arg_v a)
+{
+	fwrite(a.data, sizeof(char), a.len, stdout);
+}
+
+void report_memory()
+{
+	lal_mem_report(stderr);
+}
+
+// --mem-report goes in front of any other command and is taken out of argv, so the rest parse as usual
+bool use_report_flag(int *argc, char ***argv)
+{
+	if(*argc < 2 || (strcmp((*argv)[1], "--mem-report") != 0 && strcmp((*argv)[1], "-m") != 0))
+	{
+		return FALSE;
+	}
+
+	// lal_error exits too, so the report hangs off exit rather than the end of main
+	atexit(report_memory);
+
+	(*argv)[1] = (*argv)[0];
+	(*argc)--;
+	(*argv)++;
+
+	return TRUE;
+}
+
+commands *parse_inputs(int argc, char *argv[])
+{
+	commands *cmd = lal_malloc(LAL_MEM_COMMANDS, sizeof(commands));
+	cmd->n_cmds = 0;
+	cmd->sub_cmds = lal_malloc(LAL_MEM_COMMANDS, sizeof(struct sub_cmd) * (argc > 1 ? argc - 1 : 1));
+
+	if(argc == 1)
+	{
+		cmd->sub_cmds[0].type = EMPTY;
+		cmd->sub_cmds[0].contents.data = NULL;
+		cmd->sub_cmds[0].contents.len = 0;
+
+		return cmd;
+	}
+
+	for(int i = 1; i < argc; i++)
+	{
+		int offset = 0;
+
+		if(i == 1 && argv[i][0] == '-')
+		{
+			offset = 1;
+
+			cmd->sub_cmds[i - 1].type = FLAG;
+		}
+		else 
+		{
+			offset = 0;
+			cmd->sub_cmds[i - 1].type = INPUT;
+		}
+
+		cmd->sub_cmds[i - 1].contents.data = argv[i] + offset;
+		cmd->sub_cmds[i - 1].contents.len = strlen(argv[i]) - offset;
+
+		cmd->n_cmds++;
+	}
+
+	return cmd;
+}
+
+void print_commands(commands *cmd)
+{
+	for(int i = 0; i < cmd->n_cmds; i++)
+	{
+		switch(cmd->sub_cmds[i].type)
+		{
+			case INPUT:
+				printf("\"");
+				print_arg_v(cmd->sub_cmds[i].contents);
+				printf("\"");
+				break;
+			case FLAG:
+				printf("-");
+				print_arg_v(cmd->sub_cmds[i].contents);
+				break;
+			case EMPTY:
+				printf("<<EMPTY>>");
+				break;
+		}
+
+		printf(" ");
+	}
+
+	printf("\n");
+}
+
+void free_commands(commands *cmd)
+{
+	lal_free(LAL_MEM_COMMANDS, cmd->sub_cmds);
+	lal_free(LAL_MEM_COMMANDS, cmd);
+}
+
+FILE *open_lal()
+{
+	FILE *file = fopen(".lal", "r+b");
+
+	if(!file)
+	{
+		file = fopen(".lal", "w+b");
+	}
+
+	return file;
+}
+
+#define FLAGS_APPEND_NAME_OFFSET 1
+#define FLAGS_APPEND_INPUT_OFFSET 2
+#define FLAGS_APPEND_MIN_SUBCMDS 3
+
+#define FLAGS_TRUNCATE_NAME_OFFSET 1
+#define FLAGS_TRUNCATE_NUMBER_OFFSET 2
+#define FLAGS_TRUNCATE_MIN_SUBCMDS 2
+#define FLAGS_TRUNCATE_DEFAULT_SUBCMDS 2
+
+#define FLAGS_DELETE_NAME_OFFSET 1
+#define FLAGS_DELETE_MIN_SUBCMDS 2
+
+#define FLAGS_RENAME_NAME_OFFSET 1
+#define FLAGS_RENAME_INPUT_OFFSET 2
+#define FLAGS_RENAME_MIN_SUBCMDS 3
+
+#define FLAGS_STATS_NAME_OFFSET 1
+
+void append_to_lal(commands *cmd, alias_node **labels)
+{
+	if(cmd->n_cmds < FLAGS_APPEND_MIN_SUBCMDS)
+	{
+		lal_error(ERROR_INSUFFICIENT_INPUTS);
+	}
+
+	int n_lines = cmd->n_cmds - FLAGS_APPEND_INPUT_OFFSET;
+	arg_v *lines = lal_malloc(LAL_MEM_COMMANDS, sizeof(arg_v) * n_lines);
+
+	for(int l = 0; l < n_lines; l++)
+	{
+		lines[l] = cmd->sub_cmds[l + FLAGS_APPEND_INPUT_OFFSET].contents;
+	}
+
+	lal_check(append_lines(labels, cmd->sub_cmds[FLAGS_APPEND_NAME_OFFSET].contents, lines, n_lines));
+
+	lal_free(LAL_MEM_COMMANDS, lines);
+}
+
+void truncate_from_lal(commands *cmd, alias_node **labels)
+{
+	if(cmd->n_cmds < FLAGS_TRUNCATE_MIN_SUBCMDS)
+	{
+		lal_error(ERROR_INSUFFICIENT_INPUTS);
+	}
+
+	int n_truncate = 1;
+
+	if(cmd->n_cmds > FLAGS_TRUNCATE_DEFAULT_SUBCMDS)
+	{
+		struct sub_cmd number_input = cmd->sub_cmds[FLAGS_TRUNCATE_NUMBER_OFFSET];
+		n_truncate = nn_int_from_str(number_input.contents.data, number_input.contents.len);
+	}
+
+	lal_check(truncate_lines(labels, cmd->sub_cmds[FLAGS_TRUNCATE_NAME_OFFSET].contents, n_truncate));
+}
+
+void delete_from_lal(commands *cmd, alias_node **labels)
+{
+	if(cmd->n_cmds < FLAGS_DELETE_MIN_SUBCMDS)
+	{
+		lal_error(ERROR_INSUFFICIENT_INPUTS);
+	}
+
+	lal_check(delete_alias(labels, cmd->sub_cmds[FLAGS_DELETE_NAME_OFFSET].contents));
+}
+
+void rename_in_lal(commands *cmd, alias_node *labels)
+{
+	if(cmd->n_cmds < FLAGS_RENAME_MIN_SUBCMDS)
+	{
+		lal_error(ERROR_INSUFFICIENT_INPUTS);
+	}
+
+	lal_check(rename_alias(labels, cmd->sub_cmds[FLAGS_RENAME_NAME_OFFSET].contents, cmd->sub_cmds[FLAGS_RENAME_INPUT_OFFSET].contents));
+}
+
+#define FLAGS_EXPAND_NAME_OFFSET 1
+#define FLAGS_EXPAND_OPTIONS_OFFSET 2
+#define FLAGS_EXPAND_MIN_SUBCMDS 2
+
+#define EXPAND_FIELD_SEPARATOR '\t'
+#define EXPAND_FLUSH_SIZE 65536
+
+void expand_to_stdout(commands *cmd, alias_node *labels)
+{
+	if(cmd->n_cmds < FLAGS_EXPAND_MIN_SUBCMDS)
+	{
+		lal_error(ERROR_INSUFFICIENT_INPUTS);
+	}
+
+	alias_node *current_node = find_node(labels, cmd->sub_cmds[FLAGS_EXPAND_NAME_OFFSET].contents);
+
+	if(current_node == NULL)
+	{
+		lal_error(ERROR_LABEL_NOT_FOUND);
+	}
+
+	char delim = '\n';
+	bool quote = FALSE;
+
+	for(int sc = FLAGS_EXPAND_OPTIONS_OFFSET; sc < cmd->n_cmds; sc++)
+	{
+		arg_v option = cmd->sub_cmds[sc].contents;
+
+		if(exact_match(option.data, option.len, "-0", strlen("-0")))
+		{
+			delim = '\0';
+		}
+		else if(exact_match(option.data, option.len, "-q", strlen("-q")))
+		{
+			quote = TRUE;
+		}
+		else 
+		{
+			lal_error(ERROR_UNKNOWN_FLAG);
+		}
+	}
+
+	char *record = NULL;
+	size_t record_max = 0;
+	ssize_t record_len;
+
+	int fields_max = 16;
+	arg_v *fields = lal_malloc(LAL_MEM_COMMANDS, sizeof(arg_v) * fields_max);
+
+	char_v *out = init_char_v();
+
+	if(!fields || !out)
+	{
+		lal_error(ERROR_FAILED_RESIZE);
+	}
+
+	while((record_len = getdelim(&record, &record_max, delim, stdin)) != -1)
+	{
+		if(record_len > 0 && record[record_len - 1] == delim)
+		{
+			record_len--;
+		}
+
+		int n_fields = 0;
+		size_t start = 0;
+
+		for(size_t i = 0; i <= (size_t)record_len; i++)
+		{
+			if(i == (size_t)record_len || record[i] == EXPAND_FIELD_SEPARATOR)
+			{
+				if(n_fields == fields_max)
+				{
+					if(fields_max > INT_MAX / 2)
+					{
+						lal_error(ERROR_FAILED_RESIZE);
+					}
+
+					fields_max *= 2;
+					fields = lal_realloc(LAL_MEM_COMMANDS, fields, sizeof(arg_v) * fields_max);
+
+					if(!fields)
+					{
+						lal_error(ERROR_FAILED_RESIZE);
+					}
+				}
+
+				fields[n_fields].data = record + start;
+				fields[n_fields].len = i - start;
+				n_fields++;
+
+				start = i + 1;
+			}
+		}
+
+		for(int i = 0; i < current_node->components_len; i++)
+		{
+			if(current_node->components[i].type == LAL_NEW_LINE && directives_only(current_node, i + 1))
+			{
+				while(current_node->components[i].type != LAL_END_LINE)
+				{
+					i++;
+				}
+			}
+			else if(current_node->components[i].type == LAL_NEW_LINE)
+			{
+				i++;
+				lal_check(expand_line(out, current_node, &i, fields, n_fields, quote));
+
+				if(char_v_append(out, delim) == 0)
+				{
+					lal_error(ERROR_FAILED_RESIZE);
+				}
+			}
+		}
+
+		if(out->len >= EXPAND_FLUSH_SIZE)
+		{
+			fwrite(char_v_data(out), sizeof(char), out->len, stdout);
+			out->len = 0;
+		}
+	}
+
+	fwrite(char_v_data(out), sizeof(char), out->len, stdout);
+	fflush(stdout);
+
+	free_char_v(out);
+	lal_free(LAL_MEM_COMMANDS, fields);
+	// from getdelim
+	free(record);
+}
+
+#define FLAGS_EXPORT_SHELL_OFFSET 1
+#define FLAGS_EXPORT_MIN_SUBCMDS 2
+
+void export_to_stdout(commands *cmd, alias_node *labels)
+{
+	if(cmd->n_cmds < FLAGS_EXPORT_MIN_SUBCMDS)
+	{
+		lal_error(ERROR_INSUFFICIENT_INPUTS);
+	}
+
+	arg_v shell = cmd->sub_cmds[FLAGS_EXPORT_SHELL_OFFSET].contents;
+	enum shell_kind kind;
+
+	if(!shell_kind_from_str(shell.data, shell.len, &kind))
+	{
+		lal_error(ERROR_UNKNOWN_SHELL);
+	}
+
+	char dir[PATH_MAX];
+	char_v *out = init_char_v();
+
+	if(!getcwd(dir, sizeof(dir)) || !out)
+	{
+		lal_error(ERROR_FAILED_RESIZE);
+	}
+
+	lal_check(export_aliases(out, labels, kind, dir));
+
+	fwrite(char_v_data(out), sizeof(char), out->len, stdout);
+	free_char_v(out);
+}
+
+#define FLAGS_INDEX_ROOT_OFFSET 1
+#define FLAGS_FIND_NAME_OFFSET 1
+#define FLAGS_FIND_MIN_SUBCMDS 2
+
+void index_to_stdout(commands *cmd)
+{
+	// argv strings, so the view is also nul-terminated
+	const char *root = cmd->n_cmds > FLAGS_INDEX_ROOT_OFFSET ? cmd->sub_cmds[FLAGS_INDEX_ROOT_OFFSET].contents.data : ".";
+	struct index_counts counts;
+
+	lal_check(index_tree(root, &counts));
+
+	printf("indexed %d aliases from %d .lal files in %d directories (%d directories and %d files reread)\n", counts.aliases, counts.files, counts.dirs, counts.dirs_read, counts.files_read);
+}
+
+void find_to_stdout(commands *cmd)
+{
+	if(cmd->n_cmds < FLAGS_FIND_MIN_SUBCMDS)
+	{
+		lal_error(ERROR_INSUFFICIENT_INPUTS);
+	}
+
+	arg_v name = cmd->sub_cmds[FLAGS_FIND_NAME_OFFSET].contents;
+	char_v *out = init_char_v();
+
+	if(!out)
+	{
+		lal_error(ERROR_FAILED_RESIZE);
+	}
+
+	lal_check(index_find(out, name.data, name.len));
+
+	fwrite(char_v_data(out), sizeof(char), out->len, stdout);
+	free_char_v(out);
+}
+
+// the index spans many .lal files, so these run before any one is opened
+int use_index_flags(commands *cmd)
+{
+	arg_v flag = cmd->sub_cmds[0].contents;
+
+	if(cmd->sub_cmds[0].type != FLAG)
+	{
+		return 0;
+	}
+
+	if(exact_match(flag.data, flag.len, "-index", strlen("-index")) || exact_match(flag.data, flag.len, "i", strlen("i")))
+	{
+		index_to_stdout(cmd);
+
+		return 1;
+	}
+	else if(exact_match(flag.data, flag.len, "-find", strlen("-find")) || exact_match(flag.data, flag.len, "f", strlen("f")))
+	{
+		find_to_stdout(cmd);
+
+		return 1;
+	}
+
+	return 0;
+}
+
+int use_flags(commands *cmd, alias_node **labels, FILE *file)
+{
+	arg_v flag = cmd->sub_cmds[0].contents;
+	bool sorted = file_sorted(file);
+
+	if(exact_match(flag.data, flag.len, "-append", strlen("-append")) || exact_match(flag.data, flag.len, "a", strlen("a")))
+	{
+		append_to_lal(cmd, labels);
+	}
+	else if(exact_match(flag.data, flag.len, "-truncate", strlen("-truncate")) || exact_match(flag.data, flag.len, "t", strlen("t")))
+	{
+		truncate_from_lal(cmd, labels);
+	}
+	else if(exact_match(flag.data, flag.len, "-delete", strlen("-delete")) || exact_match(flag.data, flag.len, "d", strlen("d")))
+	{
+		delete_from_lal(cmd, labels);
+	}
+	else if(exact_match(flag.data, flag.len, "-rename", strlen("-rename")) || exact_match(flag.data, flag.len, "rn", strlen("rn")))
+	{
+		rename_in_lal(cmd, *labels);
+	}
+	else if(exact_match(flag.data, flag.len, "-sort", strlen("-sort")))
+	{
+		sorted = TRUE;
+	}
+	else if(exact_match(flag.data, flag.len, "-unsort", strlen("-unsort")))
+	{
+		sorted = FALSE;
+	}
+	else if(exact_match(flag.data, flag.len, "-stats", strlen("-stats")) || exact_match(flag.data, flag.len, "s", strlen("s")))
+	{
+		// read-only, the .lal is left untouched
+		if(cmd->n_cmds > FLAGS_STATS_NAME_OFFSET)
+		{
+			arg_v name = cmd->sub_cmds[FLAGS_STATS_NAME_OFFSET].contents;
+
+			if(stats_print(name.data, name.len) == 0)
+			{
+				lal_error(ERROR_FAILED_STATS_READ);
+			}
+		}
+		else if(stats_print(NULL, 0) == 0)
+		{
+			lal_error(ERROR_FAILED_STATS_READ);
+		}
+
+		if(compile_cache_exists())
+		{
+			fprintf(stderr, "lalias: aliases run from the compile cache are not recorded, remove " COMPILE_DIR " to record them again\n");
+		}
+
+		return 1;
+	}
+	else if(exact_match(flag.data, flag.len, "-expand", strlen("-expand")) || exact_match(flag.data, flag.len, "e", strlen("e")))
+	{
+		expand_to_stdout(cmd, *labels);
+
+		return 1;
+	}
+	else if(exact_match(flag.data, flag.len, "-export", strlen("-export")) || exact_match(flag.data, flag.len, "x", strlen("x")))
+	{
+		export_to_stdout(cmd, *labels);
+
+		return 1;
+	}
+	else if(exact_match(flag.data, flag.len, "-compile", strlen("-compile")) || exact_match(flag.data, flag.len, "c", strlen("c")))
+	{
+		lal_check(compile_aliases(*labels));
+
+		fprintf(stderr, "lalias: compiled aliases run without lalias, so " STATS_FILE " stops recording them until " COMPILE_DIR " is removed\n");
+
+		return 1;
+	}
+	else 
+	{
+		lal_error(ERROR_UNKNOWN_FLAG);
+	}
+
+	char_v *new_lal = init_char_v();
+
+	if(!new_lal)
+	{
+		lal_error(ERROR_FAILED_RESIZE);
+	}
+
+	// a sorted .lal stays sorted through every edit, so readers can binary search it
+	if(sorted)
+	{
+		sort_nodes(labels);
+
+		if(char_v_append_str(new_lal, SORTED_HEADER) == 0)
+		{
+			lal_error(ERROR_FAILED_RESIZE);
+		}
+	}
+
+	lal_check(reconstruct_lal(new_lal, *labels));
+
+	FILE *overwrite = freopen(NULL, "w+b", file);
+
+	if(overwrite == NULL)
+	{
+		return 0;
+	}
+
+	size_t write_check = fwrite(char_v_data(new_lal), sizeof(char), new_lal->len, overwrite);
+
+	if(feof(overwrite) || write_check != new_lal->len || fflush(overwrite) != 0)
+	{
+		return 0;
+	}
+
+	free_char_v(new_lal);
+
+	// keep compiled aliases in step once they have been asked for
+	if(compile_cache_exists())
+	{
+		lal_check(compile_aliases(*labels));
+	}
+
+	return 1;
+}
+
+#define INPUT_NAME_OFFSET 0
+#define INPUT_ARGS_OFFSET 1
+#define INPUT_MIN_SUBCMDS 1
+
+void use_input(commands *cmd, alias_node *labels)
+{
+	if(cmd->n_cmds < INPUT_MIN_SUBCMDS)
+	{
+		lal_error(ERROR_INSUFFICIENT_INPUTS);
+	}
+
+	arg_v name = cmd->sub_cmds[INPUT_NAME_OFFSET].contents;
+	alias_node *current_node = find_node(labels, name);
+
+	if(current_node == NULL)
+	{
+		lal_error(ERROR_LABEL_NOT_FOUND);
+	}
+
+	// the .lal was edited by hand since the last compile, best effort like the stats
+	if(compile_cache_exists() && !compile_cache_current())
+	{
+		compile_aliases(labels);
+	}
+
+	int n_args = cmd->n_cmds - INPUT_ARGS_OFFSET;
+	arg_v *args = lal_malloc(LAL_MEM_COMMANDS, sizeof(arg_v) * (n_args > 0 ? n_args : 1));
+
+	for(int a = 0; a < n_args; a++)
+	{
+		args[a] = cmd->sub_cmds[a + INPUT_ARGS_OFFSET].contents;
+	}
+
+	int n_lines = 0;
+
+	for(int i = 0; i < current_node->components_len; i++)
+	{
+		if(current_node->components[i].type == LAL_END_LINE)
+		{
+			n_lines++;
+		}
+	}
+
+	struct line_result *results = lal_malloc(LAL_MEM_COMMANDS, sizeof(struct line_result) * (n_lines > 0 ? n_lines : 1));
+	int line = 0;
+
+	struct timespec start;
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	char_v *sys_cmd = init_char_v();
+
+	if(!args || !results || !sys_cmd)
+	{
+		lal_error(ERROR_FAILED_RESIZE);
+	}
+
+	struct line_limits defaults;
+	init_line_limits(&defaults);
+
+	// a cd line moves the whole process, the stats still belong next to the .lal
+	int origin = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+	int source_line = 0;
+	int last_status = 0;
+
+	for(int i = 0; i < current_node->components_len; i++)
+	{
+		if(current_node->components[i].type == LAL_NEW_LINE)
+		{
+			i++;
+			source_line++;
+
+			bool pass;
+			lal_check(line_guards(current_node, i, args, n_args, last_status, &pass));
+
+			if(!pass || directives_only(current_node, i))
+			{
+				if(pass)
+				{
+					lal_check(line_directives(current_node, i, &defaults));
+				}
+
+				while(current_node->components[i].type != LAL_END_LINE)
+				{
+					i++;
+				}
+
+				continue;
+			}
+
+			struct line_limits limits = defaults;
+			lal_check(line_directives(current_node, i, &limits));
+			lal_check(expand_line(sys_cmd, current_node, &i, args, n_args, FALSE));
+
+			if(char_v_append(sys_cmd, '\0') == 0)
+			{
+				lal_error(ERROR_FAILED_RESIZE);
+			}
+
+			if(!run_builtin(char_v_data(sys_cmd), &results[line]) && run_line(char_v_data(sys_cmd), &limits, &results[line]) == 0)
+			{
+				lal_error(ERROR_FAILED_SPAWN);
+			}
+
+			results[line].line = source_line;
+			last_status = line_exit_code(&results[line]);
+
+			if(results[line].timed_out)
+			{
+				fprintf(stderr, "lalias: line %d of ", source_line);
+				fwrite(name.data, sizeof(char), name.len, stderr);
+				fprintf(stderr, " timed out after %.3fs\n", results[line].wall_us / 1e6);
+			}
+
+			line++;
+			sys_cmd->len = 0;
+		}
+	}
+
+	free_char_v(sys_cmd);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	int64_t wall_us = (int64_t)(end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
+
+	if(origin >= 0)
+	{
+		fchdir(origin);
+		close(origin);
+	}
+
+	// best effort, a read-only directory must not stop aliases from running
+	stats_record_invocation(name.data, name.len, results, line, wall_us);
+
+	lal_free(LAL_MEM_COMMANDS, results);
+	lal_free(LAL_MEM_COMMANDS, args);
+}
+
+int use_default(alias_node *labels)
+{
+}
+
+int run_command(commands *cmd, alias_node **labels, FILE *file)
+{
+	if(cmd->sub_cmds[0].type == FLAG)
+	{
+		if(use_flags(cmd, labels, file) == 0)
+		{
+			lal_error(ERROR_LAL_REWRITE_FAILURE);
+		}
+	}
+	else if(cmd->sub_cmds[0].type == INPUT)
+	{
+		use_input(cmd, *labels);
+	}
+	else if(cmd->sub_cmds[0].type == EMPTY)
+	{
+	}
+
+	return 1;
+}
@@ -0,0 +1,647 @@
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "lalias.h"
+#include "exec.h"
+#include "lal_alloc.h"
+#include "lal_trace.h"
+
+static int64_t timespec_us(struct timespec t)
+{
+	return (int64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+static int64_t timeval_us(struct timeval t)
+{
+	return (int64_t)t.tv_sec * 1000000 + t.tv_usec;
+}
+
+static int64_t now_us(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return timespec_us(t);
+}
+
+static volatile sig_atomic_t pending_signal = 0;
+
+static void forward_signal(int sig)
+{
+	pending_signal = sig;
+}
+
+struct saved_signals
+{
+	struct sigaction intr;
+	struct sigaction quit;
+	struct sigaction term;
+	struct sigaction hup;
+	int supervised;
+};
+
+// a plain line ignores SIGINT and SIGQUIT like system(), a supervised one lives in its own process group and needs them passed on
+static void catch_signals(struct saved_signals *saved, int supervised)
+{
+	struct sigaction handler;
+
+	handler.sa_handler = supervised ? forward_signal : SIG_IGN;
+	handler.sa_flags = 0;
+	sigemptyset(&handler.sa_mask);
+
+	pending_signal = 0;
+	saved->supervised = supervised;
+
+	sigaction(SIGINT, &handler, &saved->intr);
+	sigaction(SIGQUIT, &handler, &saved->quit);
+
+	if(supervised)
+	{
+		sigaction(SIGTERM, &handler, &saved->term);
+		sigaction(SIGHUP, &handler, &saved->hup);
+	}
+}
+
+static void restore_signals(struct saved_signals *saved)
+{
+	sigaction(SIGINT, &saved->intr, NULL);
+	sigaction(SIGQUIT, &saved->quit, NULL);
+
+	if(saved->supervised)
+	{
+		sigaction(SIGTERM, &saved->term, NULL);
+		sigaction(SIGHUP, &saved->hup, NULL);
+	}
+}
+
+static int owns_terminal(void)
+{
+	return isatty(STDIN_FILENO) && tcgetpgrp(STDIN_FILENO) == getpgrp();
+}
+
+static void give_terminal(pid_t pgid)
+{
+	sigset_t ttou;
+	sigset_t old;
+
+	sigemptyset(&ttou);
+	sigaddset(&ttou, SIGTTOU);
+
+	sigprocmask(SIG_BLOCK, &ttou, &old);
+	tcsetpgrp(STDIN_FILENO, pgid);
+	sigprocmask(SIG_SETMASK, &old, NULL);
+}
+
+// never raises a limit past the current hard one
+static int lower_limit(int resource, int64_t soft, int64_t hard)
+{
+	struct rlimit r;
+
+	if(soft < 0)
+	{
+		return 1;
+	}
+
+	if(getrlimit(resource, &r) != 0)
+	{
+		return 0;
+	}
+
+	if(r.rlim_max != RLIM_INFINITY && (rlim_t)hard > r.rlim_max)
+	{
+		hard = r.rlim_max;
+	}
+
+	r.rlim_cur = (rlim_t)soft < (rlim_t)hard ? (rlim_t)soft : (rlim_t)hard;
+	r.rlim_max = hard;
+
+	return setrlimit(resource, &r) == 0;
+}
+
+static int apply_limits(const struct line_limits *limits)
+{
+	// a spare second of cpu turns the SIGXCPU into a SIGKILL
+	return lower_limit(RLIMIT_CPU, limits->cpu_s, limits->cpu_s + 1)
+		&& lower_limit(RLIMIT_AS, limits->mem_bytes, limits->mem_bytes)
+		&& lower_limit(RLIMIT_NOFILE, limits->nofile, limits->nofile);
+}
+
+static int open_pidfd(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+	return syscall(SYS_pidfd_open, pid, 0);
+#else
+	return -1;
+#endif
+}
+
+// waits for pid until the timeout, then SIGTERMs its group and SIGKILLs it after the grace period; *reaped is set if the child was already waited for
+static void supervise(pid_t pid, const struct line_limits *limits, int64_t start, struct line_result *result, int *status, struct rusage *usage, int *reaped)
+{
+	int pidfd = open_pidfd(pid);
+	int64_t deadline = start + limits->timeout_us;
+
+	*reaped = 0;
+
+	while(1)
+	{
+		if(pending_signal)
+		{
+			kill(-pid, pending_signal);
+			pending_signal = 0;
+		}
+
+		int64_t remaining = deadline - now_us();
+
+		if(remaining <= 0)
+		{
+			if(result->timed_out)
+			{
+				kill(-pid, SIGKILL);
+				break;
+			}
+
+			result->timed_out = 1;
+			kill(-pid, SIGTERM);
+			kill(-pid, SIGCONT);
+
+			deadline = now_us() + limits->grace_us;
+			continue;
+		}
+
+		if(pidfd >= 0)
+		{
+			struct pollfd exited = { pidfd, POLLIN, 0 };
+			int r = poll(&exited, 1, remaining > 60000000 ? 60000 : (int)((remaining + 999) / 1000));
+
+			if(r > 0 || (r < 0 && errno != EINTR))
+			{
+				break;
+			}
+		}
+		else 
+		{
+			// no pidfds before linux 5.3, fall back to polling
+			pid_t r = wait4(pid, status, WNOHANG, usage);
+
+			if(r == pid)
+			{
+				*reaped = 1;
+				break;
+			}
+
+			if(r < 0 && errno != EINTR)
+			{
+				break;
+			}
+
+			struct timespec nap = { 0, remaining < 10000 ? remaining * 1000 : 10000000 };
+			nanosleep(&nap, NULL);
+		}
+	}
+
+	// the shell may be gone while what it started still holds the group
+	if(result->timed_out && !*reaped)
+	{
+		kill(-pid, SIGKILL);
+	}
+
+	if(pidfd >= 0)
+	{
+		close(pidfd);
+	}
+}
+
+// like system(), but keeps the child's rusage and the elapsed time, and enforces limits when given
+int run_line(const char *line, const struct line_limits *limits, struct line_result *result)
+{
+	int supervised = limits && limits->timeout_us > 0;
+	int terminal = supervised && owns_terminal();
+	struct saved_signals saved;
+
+	catch_signals(&saved, supervised);
+
+	fflush(stdout);
+
+	result->timed_out = 0;
+	int64_t start = now_us();
+
+	pid_t pid = fork();
+
+	if(pid == 0)
+	{
+		if(supervised)
+		{
+			setpgid(0, 0);
+
+			if(terminal)
+			{
+				give_terminal(getpid());
+			}
+		}
+
+		restore_signals(&saved);
+
+		if(limits && !apply_limits(limits))
+		{
+			perror("lalias: setrlimit");
+			_exit(126);
+		}
+
+		execl("/bin/sh", "sh", "-c", line, (char *)NULL);
+		_exit(127);
+	}
+
+	if(pid < 0)
+	{
+		restore_signals(&saved);
+
+		return 0;
+	}
+
+	LAL_TRACE2(line_spawn, (int)pid, line);
+
+	int status = 0;
+	int reaped = 0;
+	struct rusage usage;
+
+	if(supervised)
+	{
+		// also done here so neither side races the other
+		setpgid(pid, pid);
+
+		if(terminal)
+		{
+			give_terminal(pid);
+		}
+
+		supervise(pid, limits, start, result, &status, &usage, &reaped);
+	}
+
+	while(!reaped)
+	{
+		if(wait4(pid, &status, 0, &usage) == pid)
+		{
+			reaped = 1;
+		}
+		else if(errno != EINTR)
+		{
+			break;
+		}
+	}
+
+	int64_t end = now_us();
+
+	if(terminal)
+	{
+		give_terminal(getpgrp());
+	}
+
+	restore_signals(&saved);
+
+	if(!reaped)
+	{
+		return 0;
+	}
+
+	result->status = status;
+	result->wall_us = end - start;
+	result->user_us = timeval_us(usage.ru_utime);
+	result->sys_us = timeval_us(usage.ru_stime);
+
+	LAL_TRACE3(line_done, (int)pid, status, result->wall_us);
+
+	return 1;
+}
+
+enum builtin
+{
+	BUILTIN_NONE,
+	BUILTIN_CD,
+	BUILTIN_EXPORT,
+	BUILTIN_UNSET,
+	BUILTIN_ECHO
+};
+
+// splits line into nul-terminated words in buf when a shell would do nothing but split and unquote it, -1 otherwise
+static int split_plain(const char *line, char *buf, char **words, int max_words)
+{
+	int n_words = 0;
+	char quote = 0;
+	int in_word = 0;
+
+	for(; *line; line++)
+	{
+		char c = *line;
+
+		// backslashes also stay with the shell so echo keeps its escapes wherever sh interprets them
+		if(c == '\\' || (quote == '"' && (c == '$' || c == '`')))
+		{
+			return -1;
+		}
+
+		if(quote)
+		{
+			if(c == quote)
+			{
+				quote = 0;
+			}
+			else 
+			{
+				*buf++ = c;
+			}
+
+			continue;
+		}
+
+		if(c == ' ' || c == '\t')
+		{
+			if(in_word)
+			{
+				*buf++ = '\0';
+				in_word = 0;
+			}
+
+			continue;
+		}
+
+		if(strchr("|&;<>()$`*?[#~{}\n", c))
+		{
+			return -1;
+		}
+
+		if(!in_word)
+		{
+			if(n_words == max_words)
+			{
+				return -1;
+			}
+
+			words[n_words++] = buf;
+			in_word = 1;
+		}
+
+		if(c == '\'' || c == '"')
+		{
+			quote = c;
+		}
+		else 
+		{
+			*buf++ = c;
+		}
+	}
+
+	if(quote)
+	{
+		return -1;
+	}
+
+	*buf = '\0';
+
+	return n_words;
+}
+
+static int is_option(const char *word)
+{
+	return word[0] == '-' && word[1] != '\0';
+}
+
+// options are left to the shell, they differ between shells
+static enum builtin plain_builtin(char **words, int n_words)
+{
+	if(n_words == 0)
+	{
+		return BUILTIN_NONE;
+	}
+
+	enum builtin kind = BUILTIN_NONE;
+
+	if(strcmp(words[0], "cd") == 0)
+	{
+		kind = BUILTIN_CD;
+	}
+	else if(strcmp(words[0], "export") == 0 && n_words > 1)
+	{
+		kind = BUILTIN_EXPORT;
+	}
+	else if(strcmp(words[0], "unset") == 0 && n_words > 1)
+	{
+		kind = BUILTIN_UNSET;
+	}
+	else if(strcmp(words[0], "echo") == 0)
+	{
+		kind = BUILTIN_ECHO;
+	}
+
+	if(kind == BUILTIN_ECHO)
+	{
+		// shells only agree on a single leading -n
+		int w = n_words > 1 && strcmp(words[1], "-n") == 0 ? 2 : 1;
+
+		return w < n_words && is_option(words[w]) ? BUILTIN_NONE : kind;
+	}
+
+	for(int w = 1; kind != BUILTIN_NONE && w < n_words; w++)
+	{
+		if(is_option(words[w]))
+		{
+			return BUILTIN_NONE;
+		}
+	}
+
+	return kind;
+}
+
+static int builtin_cd(char **words, int n_words)
+{
+	const char *dir = n_words > 1 ? words[1] : getenv("HOME");
+	int print = n_words > 1 && strcmp(words[1], "-") == 0;
+
+	if(n_words > 2)
+	{
+		fprintf(stderr, "lalias: cd: too many arguments\n");
+		return 1;
+	}
+
+	if(print)
+	{
+		dir = getenv("OLDPWD");
+	}
+
+	if(dir == NULL)
+	{
+		fprintf(stderr, "lalias: cd: %s not set\n", print ? "OLDPWD" : "HOME");
+		return 1;
+	}
+
+	char *old = getcwd(NULL, 0);
+
+	if(chdir(dir) != 0)
+	{
+		fprintf(stderr, "lalias: cd: %s: %s\n", dir, strerror(errno));
+		free(old);
+		return 1;
+	}
+
+	char *now = getcwd(NULL, 0);
+
+	if(old)
+	{
+		setenv("OLDPWD", old, 1);
+	}
+
+	if(now)
+	{
+		setenv("PWD", now, 1);
+
+		if(print)
+		{
+			printf("%s\n", now);
+			fflush(stdout);
+		}
+	}
+
+	free(old);
+	free(now);
+
+	return 0;
+}
+
+static int builtin_env(enum builtin kind, char **words, int n_words)
+{
+	int status = 0;
+
+	for(int w = 1; w < n_words; w++)
+	{
+		char *equals = kind == BUILTIN_EXPORT ? strchr(words[w], '=') : NULL;
+		arg_v name = { words[w], equals ? (size_t)(equals - words[w]) : strlen(words[w]) };
+
+		if(!env_name_valid(name))
+		{
+			fprintf(stderr, "lalias: %s: '%s': not a valid identifier\n", words[0], words[w]);
+			status = 1;
+		}
+		else if(kind == BUILTIN_UNSET)
+		{
+			unsetenv(words[w]);
+		}
+		else if(equals)
+		{
+			// a bare NAME only marks it exported, and everything in our environment already is
+			*equals = '\0';
+			setenv(words[w], equals + 1, 1);
+		}
+	}
+
+	return status;
+}
+
+static int builtin_echo(char **words, int n_words)
+{
+	int newline = n_words < 2 || strcmp(words[1], "-n") != 0;
+
+	for(int w = newline ? 1 : 2; w < n_words; w++)
+	{
+		fputs(words[w], stdout);
+
+		if(w + 1 < n_words)
+		{
+			putchar(' ');
+		}
+	}
+
+	if(newline)
+	{
+		putchar('\n');
+	}
+
+	// later lines write to the same descriptor
+	return fflush(stdout) == 0 ? 0 : 1;
+}
+
+#define BUILTIN_MAX_WORDS 64
+
+int builtin_line(const char *line)
+{
+	char *buf = lal_malloc(LAL_MEM_EXEC, strlen(line) + 1);
+	char *words[BUILTIN_MAX_WORDS];
+
+	if(buf == NULL)
+	{
+		return 0;
+	}
+
+	int n_words = split_plain(line, buf, words, BUILTIN_MAX_WORDS);
+	int builtin = n_words >= 0 && plain_builtin(words, n_words) != BUILTIN_NONE;
+
+	lal_free(LAL_MEM_EXEC, buf);
+
+	return builtin;
+}
+
+int run_builtin(const char *line, struct line_result *result)
+{
+	char *buf = lal_malloc(LAL_MEM_EXEC, strlen(line) + 1);
+	char *words[BUILTIN_MAX_WORDS];
+
+	if(buf == NULL)
+	{
+		return 0;
+	}
+
+	int64_t start = now_us();
+	int n_words = split_plain(line, buf, words, BUILTIN_MAX_WORDS);
+	enum builtin kind = n_words >= 0 ? plain_builtin(words, n_words) : BUILTIN_NONE;
+	int code = 0;
+
+	switch (kind)
+	{
+		case BUILTIN_NONE:
+			lal_free(LAL_MEM_EXEC, buf);
+			return 0;
+		case BUILTIN_CD:
+			code = builtin_cd(words, n_words);
+			break;
+		case BUILTIN_EXPORT:
+		case BUILTIN_UNSET:
+			code = builtin_env(kind, words, n_words);
+			break;
+		case BUILTIN_ECHO:
+			code = builtin_echo(words, n_words);
+			break;
+	}
+
+	lal_free(LAL_MEM_EXEC, buf);
+
+	result->status = W_EXITCODE(code, 0);
+	result->wall_us = now_us() - start;
+	result->user_us = 0;
+	result->sys_us = 0;
+	result->timed_out = 0;
+
+	LAL_TRACE3(line_done, 0, result->status, result->wall_us);
+
+	return 1;
+}
+
+int line_failed(struct line_result *result)
+{
+	return !WIFEXITED(result->status) || WEXITSTATUS(result->status) != 0;
+}
+
+// as a shell reports it in $?
+int line_exit_code(struct line_result *result)
+{
+	return WIFEXITED(result->status) ? WEXITSTATUS(result->status) : 128 + WTERMSIG(result->status);
+}
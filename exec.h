@@ -0,0 +1,22 @@
+#include <stdint.h>
+
+struct line_limits;
+
+struct line_result
+{
+	int status;
+	int64_t wall_us;
+	int64_t user_us;
+	int64_t sys_us;
+	int line; // 1-based position in the alias
+	int timed_out;
+};
+
+// limits may be NULL
+int run_line(const char *line, const struct line_limits *limits, struct line_result *result);
+// cd, export, unset and echo on a line without shell syntax run in this process, so later lines inherit them
+int builtin_line(const char *line);
+// 0 if the line needs a shell
+int run_builtin(const char *line, struct line_result *result);
+int line_failed(struct line_result *result);
+int line_exit_code(struct line_result *result);
@@ -0,0 +1,1152 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "lalias.h"
+#include "lal_alloc.h"
+#include "index.h"
+#include "shell.h"
+
+// header, then "name\tfile\thash\tdefinition" sorted by name, then "dir\tdir stamp\t.lal stamp\tchild/child" sorted by dir
+#define INDEX_MAGIC "lalias-index 1\t"
+#define INDEX_OFFSET_WIDTH 20
+#define INDEX_MAX_THREADS 16
+#define INDEX_STAMP_SIZE 64
+#define INDEX_NO_STAMP "-"
+
+static const char *const skipped_dirs[] = { "node_modules", "vendor", "third_party" };
+
+struct old_index
+{
+	const char *data;
+	off_t size;
+	const char *aliases;
+	const char *dirs;
+	bool ignore_same; // otherwise no directory can be trusted to have the same children
+};
+
+// a deque of relative directory paths; the owner works from the back, thieves take from the front
+struct crawl_queue
+{
+	pthread_mutex_t lock;
+	char **paths;
+	int head;
+	int len;
+	int max;
+};
+
+struct crawl
+{
+	const char *root;
+	struct old_index *old;
+	char **ignores;
+	int n_ignores;
+	struct crawl_queue queues[INDEX_MAX_THREADS];
+	int n_queues;
+	atomic_long pending; // directories queued or being read
+	// a worker with nothing to take sleeps on idle until a push or the last directory finishes
+	pthread_mutex_t idle_lock;
+	pthread_cond_t idle;
+	atomic_long pushes;
+	atomic_int sleepers;
+};
+
+struct crawl_worker
+{
+	struct crawl *crawl;
+	int id;
+	char_v aliases;
+	char_v dirs;
+	char_v kept; // escaped .lal paths whose old records still hold, one per line
+	int dirs_read;
+	int files_read;
+	enum error_code error;
+	pthread_t thread;
+};
+
+struct index_line
+{
+	const char *data;
+	size_t len;
+};
+
+// mtime and size, enough to notice an edit without reading anything
+static void format_stat(char *out, struct stat *st)
+{
+	snprintf(out, INDEX_STAMP_SIZE, "%lld.%09ld:%lld", (long long)st->st_mtim.tv_sec, st->st_mtim.tv_nsec, (long long)st->st_size);
+}
+
+// fields are tab-separated, so tabs, newlines and backslashes inside them are escaped
+static int append_escaped(char_v *out, const char *str, size_t len)
+{
+	int ok = 1;
+
+	for(size_t c = 0; ok && c < len; c++)
+	{
+		switch (str[c])
+		{
+			case '\t':
+				ok = char_v_append_str(out, "\\t");
+				break;
+			case '\n':
+				ok = char_v_append_str(out, "\\n");
+				break;
+			case '\\':
+				ok = char_v_append_str(out, "\\\\");
+				break;
+			default:
+				ok = char_v_append(out, str[c]);
+				break;
+		}
+	}
+
+	return ok;
+}
+
+static int append_unescaped(char_v *out, arg_v field)
+{
+	int ok = 1;
+
+	for(size_t c = 0; ok && c < field.len; c++)
+	{
+		if(field.data[c] == '\\' && c + 1 < field.len)
+		{
+			c++;
+			ok = char_v_append(out, field.data[c] == 't' ? '\t' : field.data[c] == 'n' ? '\n' : field.data[c]);
+		}
+		else 
+		{
+			ok = char_v_append(out, field.data[c]);
+		}
+	}
+
+	return ok;
+}
+
+static const char *line_end(const char *line, const char *end)
+{
+	const char *newline = memchr(line, '\n', end - line);
+
+	return newline ? newline : end;
+}
+
+// the nth tab-separated field of the line at line
+static arg_v line_field(const char *line, const char *end, int n)
+{
+	const char *stop = line_end(line, end);
+
+	for(; n > 0 && line < stop; n--)
+	{
+		const char *tab = memchr(line, '\t', stop - line);
+
+		line = tab ? tab + 1 : stop;
+	}
+
+	const char *tab = memchr(line, '\t', stop - line);
+	arg_v field = { line, (tab ? tab : stop) - line };
+
+	return field;
+}
+
+static int compare_keys(arg_v a, arg_v b)
+{
+	int cmp = memcmp(a.data, b.data, a.len < b.len ? a.len : b.len);
+
+	return cmp != 0 ? cmp : a.len < b.len ? -1 : a.len > b.len;
+}
+
+// the first line in [begin, end) whose first field is not below key; lines are sorted by it
+static const char *lower_bound(const char *begin, const char *end, arg_v key)
+{
+	while(begin < end)
+	{
+		const char *mid = begin + (end - begin) / 2;
+
+		while(mid > begin && mid[-1] != '\n')
+		{
+			mid--;
+		}
+
+		if(compare_keys(line_field(mid, end, 0), key) < 0)
+		{
+			const char *next = line_end(mid, end);
+
+			begin = next < end ? next + 1 : end;
+		}
+		else 
+		{
+			end = mid;
+		}
+	}
+
+	return begin;
+}
+
+static int compare_lines(const void *a, const void *b)
+{
+	const struct index_line *la = a;
+	const struct index_line *lb = b;
+	const char *a_end = la->data + la->len;
+	const char *b_end = lb->data + lb->len;
+
+	int cmp = compare_keys(line_field(la->data, a_end, 0), line_field(lb->data, b_end, 0));
+
+	if(cmp != 0)
+	{
+		return cmp;
+	}
+
+	arg_v whole_a = { la->data, la->len };
+	arg_v whole_b = { lb->data, lb->len };
+
+	return compare_keys(whole_a, whole_b);
+}
+
+static void load_old_index(struct old_index *old, const char *path, const char *ignore_stamp)
+{
+	memset(old, 0, sizeof(*old));
+
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+
+	if(fd < 0)
+	{
+		return;
+	}
+
+	if(fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		close(fd);
+		return;
+	}
+
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if(data == MAP_FAILED)
+	{
+		return;
+	}
+
+	const char *end = (const char *)data + st.st_size;
+	const char *header_end = line_end(data, end);
+	arg_v magic = line_field(data, end, 0);
+	arg_v ignore = line_field(data, end, 1);
+	arg_v offset = line_field(data, end, 2);
+	long long dirs = offset.len == INDEX_OFFSET_WIDTH ? atoll(offset.data) : -1;
+
+	// anything unexpected is treated as no index at all
+	if(header_end == end || magic.len + 1 != strlen(INDEX_MAGIC) || memcmp(magic.data, INDEX_MAGIC, magic.len) != 0 || dirs <= header_end - (const char *)data || dirs > st.st_size)
+	{
+		munmap(data, st.st_size);
+		return;
+	}
+
+	old->data = data;
+	old->size = st.st_size;
+	old->aliases = header_end + 1;
+	old->dirs = (const char *)data + dirs;
+	old->ignore_same = ignore.len == strlen(ignore_stamp) && memcmp(ignore.data, ignore_stamp, ignore.len) == 0;
+}
+
+static void free_old_index(struct old_index *old)
+{
+	if(old->data)
+	{
+		munmap((void *)old->data, old->size);
+	}
+}
+
+// the old record for dir, NULL if there is none
+static const char *old_dir(struct old_index *old, arg_v dir)
+{
+	if(old->data == NULL)
+	{
+		return NULL;
+	}
+
+	const char *end = old->data + old->size;
+	const char *line = lower_bound(old->dirs, end, dir);
+
+	return line < end && compare_keys(line_field(line, end, 0), dir) == 0 ? line : NULL;
+}
+
+// one pattern per line, blank lines and # comments skipped
+static enum error_code load_ignores(struct crawl *crawl, char *contents)
+{
+	int n = 1;
+
+	for(char *c = contents; *c; c++)
+	{
+		n += *c == '\n';
+	}
+
+	crawl->ignores = lal_malloc(LAL_MEM_INDEX, sizeof(char *) * n);
+
+	if(!crawl->ignores)
+	{
+		return ERROR_FAILED_RESIZE;
+	}
+
+	for(char *line = strtok(contents, "\n"); line != NULL; line = strtok(NULL, "\n"))
+	{
+		int len = strlen(line);
+
+		while(len > 0 && (line[len - 1] == '\r' || line[len - 1] == ' ' || line[len - 1] == '/'))
+		{
+			line[--len] = '\0';
+		}
+
+		if(len > 0 && line[0] != '#')
+		{
+			crawl->ignores[crawl->n_ignores++] = line;
+		}
+	}
+
+	return ERROR_NONE;
+}
+
+static bool skip_dir(struct crawl *crawl, const char *name, const char *rel)
+{
+	// hidden, and names that cannot be written to the index
+	if(name[0] == '.' || strpbrk(name, "\t\n\\") != NULL)
+	{
+		return TRUE;
+	}
+
+	for(int k = 0; k < sizeof(skipped_dirs) / sizeof(skipped_dirs[0]); k++)
+	{
+		if(strcmp(name, skipped_dirs[k]) == 0)
+		{
+			return TRUE;
+		}
+	}
+
+	for(int k = 0; k < crawl->n_ignores; k++)
+	{
+		if(fnmatch(crawl->ignores[k], name, 0) == 0 || fnmatch(crawl->ignores[k], rel, FNM_PATHNAME) == 0)
+		{
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+static int join_path(char *out, const char *dir, const char *name)
+{
+	int n = strcmp(dir, ".") == 0 ? snprintf(out, PATH_MAX, "%s", name) : snprintf(out, PATH_MAX, "%s/%s", dir, name);
+
+	return n > 0 && n < PATH_MAX;
+}
+
+// pushes is bumped before sleepers is read and a sleeper counts itself before rereading pushes, so one side always sees the other
+static void wake_idle(struct crawl *crawl, bool all)
+{
+	if(!all)
+	{
+		atomic_fetch_add(&crawl->pushes, 1);
+	}
+
+	if(atomic_load(&crawl->sleepers) > 0)
+	{
+		pthread_mutex_lock(&crawl->idle_lock);
+
+		if(all)
+		{
+			pthread_cond_broadcast(&crawl->idle);
+		}
+		else 
+		{
+			pthread_cond_signal(&crawl->idle);
+		}
+
+		pthread_mutex_unlock(&crawl->idle_lock);
+	}
+}
+
+static enum error_code push_dir(struct crawl_worker *worker, const char *rel, int len)
+{
+	struct crawl_queue *queue = &worker->crawl->queues[worker->id];
+	char *path = lal_malloc(LAL_MEM_INDEX, len + 1);
+
+	if(!path)
+	{
+		return ERROR_FAILED_RESIZE;
+	}
+
+	memcpy(path, rel, len);
+	path[len] = '\0';
+
+	pthread_mutex_lock(&queue->lock);
+
+	if(queue->len == queue->max)
+	{
+		int max = queue->max ? queue->max * 2 : 64;
+		char **paths = lal_realloc(LAL_MEM_INDEX, queue->paths, sizeof(char *) * max);
+
+		if(!paths)
+		{
+			pthread_mutex_unlock(&queue->lock);
+			lal_free(LAL_MEM_INDEX, path);
+
+			return ERROR_FAILED_RESIZE;
+		}
+
+		queue->paths = paths;
+		queue->max = max;
+	}
+
+	atomic_fetch_add(&worker->crawl->pending, 1);
+	queue->paths[queue->len++] = path;
+
+	pthread_mutex_unlock(&queue->lock);
+
+	wake_idle(worker->crawl, FALSE);
+
+	return ERROR_NONE;
+}
+
+// depth first from our own queue, otherwise the shallowest directory of someone else's
+static char *take_dir(struct crawl *crawl, int id)
+{
+	for(int k = 0; k < crawl->n_queues; k++)
+	{
+		struct crawl_queue *queue = &crawl->queues[(id + k) % crawl->n_queues];
+		char *path = NULL;
+
+		pthread_mutex_lock(&queue->lock);
+
+		if(queue->head < queue->len)
+		{
+			path = k == 0 ? queue->paths[--queue->len] : queue->paths[queue->head++];
+		}
+
+		if(queue->head == queue->len)
+		{
+			queue->head = 0;
+			queue->len = 0;
+		}
+
+		pthread_mutex_unlock(&queue->lock);
+
+		if(path)
+		{
+			return path;
+		}
+	}
+
+	return NULL;
+}
+
+// the subdirectories worth crawling, joined by '/'
+static enum error_code read_children(struct crawl *crawl, const char *path, const char *rel, char_v *children)
+{
+	DIR *dir = opendir(path);
+
+	if(!dir)
+	{
+		// unreadable directories are left out rather than failing the whole index
+		return ERROR_NONE;
+	}
+
+	struct dirent *entry;
+	enum error_code error = ERROR_NONE;
+
+	while(error == ERROR_NONE && (entry = readdir(dir)) != NULL)
+	{
+		char child_rel[PATH_MAX];
+		char child_path[PATH_MAX];
+		int is_dir = entry->d_type == DT_DIR;
+
+		if(!join_path(child_rel, rel, entry->d_name) || skip_dir(crawl, entry->d_name, child_rel))
+		{
+			continue;
+		}
+
+		// symlinks are not followed, so the crawl cannot loop
+		if(entry->d_type == DT_UNKNOWN)
+		{
+			struct stat st;
+
+			is_dir = snprintf(child_path, sizeof(child_path), "%s/%s", path, entry->d_name) < sizeof(child_path) && lstat(child_path, &st) == 0 && S_ISDIR(st.st_mode);
+		}
+
+		if(is_dir && ((children->len > 0 && !char_v_append(children, '/')) || !char_v_append_str(children, entry->d_name)))
+		{
+			error = ERROR_FAILED_RESIZE;
+		}
+	}
+
+	closedir(dir);
+
+	return error;
+}
+
+static enum error_code index_lal(struct crawl_worker *worker, const char *path, const char *rel)
+{
+	FILE *file = fopen(path, "rb");
+	alias_node *nodes = NULL;
+
+	if(!file)
+	{
+		return ERROR_NONE;
+	}
+
+	enum error_code e = process_lal_file(file, &nodes);
+	fclose(file);
+
+	worker->files_read++;
+
+	// one broken .lal must not keep the rest of the tree out of the index
+	if(e != ERROR_NONE)
+	{
+		fprintf(stderr, "lalias: skipping %s: %s\n", path, lal_strerror(e));
+		free_nodes(nodes);
+
+		return e == ERROR_FAILED_RESIZE ? e : ERROR_NONE;
+	}
+
+	char_v *definition = init_char_v();
+	int ok = definition != NULL;
+
+	for(alias_node *node = nodes; ok && node != NULL; node = node->next_node)
+	{
+		char hash[INDEX_STAMP_SIZE];
+		alias_node *next = node->next_node;
+
+		definition->len = 0;
+		node->next_node = NULL;
+		e = reconstruct_lal(definition, node);
+		node->next_node = next;
+
+		if(e != ERROR_NONE)
+		{
+			ok = 0;
+			break;
+		}
+
+		// no trailing newline
+		definition->len--;
+		snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)shell_alias_hash(node));
+
+		ok = append_escaped(&worker->aliases, char_v_data(&node->name), node->name.len) && char_v_append(&worker->aliases, '\t');
+		ok = ok && append_escaped(&worker->aliases, rel, strlen(rel)) && char_v_append(&worker->aliases, '\t');
+		ok = ok && char_v_append_str(&worker->aliases, hash) && char_v_append(&worker->aliases, '\t');
+		ok = ok && append_escaped(&worker->aliases, char_v_data(definition), definition->len) && char_v_append(&worker->aliases, '\n');
+	}
+
+	if(definition)
+	{
+		free_char_v(definition);
+	}
+
+	free_nodes(nodes);
+
+	return ok ? ERROR_NONE : ERROR_FAILED_RESIZE;
+}
+
+// an unchanged directory keeps its recorded children and is never opened, only stat'ed
+static enum error_code visit_dir(struct crawl_worker *worker, const char *rel)
+{
+	struct crawl *crawl = worker->crawl;
+	char path[PATH_MAX];
+	char lal_path[PATH_MAX];
+	char lal_rel[PATH_MAX];
+	char dir_stamp[INDEX_STAMP_SIZE];
+	char lal_stamp[INDEX_STAMP_SIZE] = INDEX_NO_STAMP;
+	struct stat st;
+
+	if(!join_path(path, crawl->root, rel))
+	{
+		return ERROR_NONE;
+	}
+
+	// gone since its parent was read
+	if(lstat(path, &st) != 0 || !S_ISDIR(st.st_mode))
+	{
+		return ERROR_NONE;
+	}
+
+	format_stat(dir_stamp, &st);
+
+	if(!join_path(lal_path, path, ".lal") || !join_path(lal_rel, rel, ".lal"))
+	{
+		return ERROR_NONE;
+	}
+
+	if(stat(lal_path, &st) == 0 && S_ISREG(st.st_mode))
+	{
+		format_stat(lal_stamp, &st);
+	}
+
+	arg_v rel_key = { rel, strlen(rel) };
+	const char *old = old_dir(crawl->old, rel_key);
+	const char *old_end = old ? crawl->old->data + crawl->old->size : NULL;
+	arg_v old_dir_stamp = old ? line_field(old, old_end, 1) : rel_key;
+	arg_v old_lal_stamp = old ? line_field(old, old_end, 2) : rel_key;
+
+	char_v children;
+	char_v_init(&children);
+
+	enum error_code error = ERROR_NONE;
+	arg_v child_list;
+
+	if(old && crawl->old->ignore_same && old_dir_stamp.len == strlen(dir_stamp) && memcmp(old_dir_stamp.data, dir_stamp, old_dir_stamp.len) == 0)
+	{
+		child_list = line_field(old, old_end, 3);
+	}
+	else 
+	{
+		error = read_children(crawl, path, rel, &children);
+		worker->dirs_read++;
+
+		child_list.data = char_v_data(&children);
+		child_list.len = children.len;
+	}
+
+	if(error == ERROR_NONE && strcmp(lal_stamp, INDEX_NO_STAMP) != 0)
+	{
+		if(old && old_lal_stamp.len == strlen(lal_stamp) && memcmp(old_lal_stamp.data, lal_stamp, old_lal_stamp.len) == 0)
+		{
+			error = append_escaped(&worker->kept, lal_rel, strlen(lal_rel)) && char_v_append(&worker->kept, '\n') ? ERROR_NONE : ERROR_FAILED_RESIZE;
+		}
+		else 
+		{
+			error = index_lal(worker, lal_path, lal_rel);
+		}
+	}
+
+	int ok = error == ERROR_NONE && char_v_append_str(&worker->dirs, rel) && char_v_append(&worker->dirs, '\t');
+
+	ok = ok && char_v_append_str(&worker->dirs, dir_stamp) && char_v_append(&worker->dirs, '\t');
+	ok = ok && char_v_append_str(&worker->dirs, lal_stamp) && char_v_append(&worker->dirs, '\t');
+	ok = ok && char_v_append_arg_v(&worker->dirs, child_list) && char_v_append(&worker->dirs, '\n');
+
+	if(error == ERROR_NONE && !ok)
+	{
+		error = ERROR_FAILED_RESIZE;
+	}
+
+	for(size_t c = 0; error == ERROR_NONE && c < child_list.len; c++)
+	{
+		const char *name = child_list.data + c;
+		const char *slash = memchr(name, '/', child_list.len - c);
+		size_t len = slash ? (size_t)(slash - name) : child_list.len - c;
+		char child[PATH_MAX];
+		char child_rel[PATH_MAX];
+
+		if(len < sizeof(child) && snprintf(child, sizeof(child), "%.*s", (int)len, name) < sizeof(child) && join_path(child_rel, rel, child))
+		{
+			error = push_dir(worker, child_rel, strlen(child_rel));
+		}
+
+		c += len;
+	}
+
+	char_v_release(&children);
+
+	return error;
+}
+
+static void *crawl_worker(void *arg)
+{
+	struct crawl_worker *worker = arg;
+	struct crawl *crawl = worker->crawl;
+
+	while(1)
+	{
+		long seen = atomic_load(&crawl->pushes);
+		char *rel = take_dir(crawl, worker->id);
+
+		if(rel == NULL)
+		{
+			// someone is still reading a directory that may push more, so wait for a push or for the crawl to end
+			atomic_fetch_add(&crawl->sleepers, 1);
+			pthread_mutex_lock(&crawl->idle_lock);
+
+			while(atomic_load(&crawl->pushes) == seen && atomic_load(&crawl->pending) != 0)
+			{
+				pthread_cond_wait(&crawl->idle, &crawl->idle_lock);
+			}
+
+			pthread_mutex_unlock(&crawl->idle_lock);
+			atomic_fetch_sub(&crawl->sleepers, 1);
+
+			if(atomic_load(&crawl->pending) == 0)
+			{
+				break;
+			}
+
+			continue;
+		}
+
+		enum error_code e = visit_dir(worker, rel);
+
+		if(worker->error == ERROR_NONE)
+		{
+			worker->error = e;
+		}
+
+		lal_free(LAL_MEM_INDEX, rel);
+
+		if(atomic_fetch_sub(&crawl->pending, 1) == 1)
+		{
+			wake_idle(crawl, TRUE);
+		}
+	}
+
+	return NULL;
+}
+
+// splits buf into lines appended to lines
+static enum error_code collect_lines(struct index_line **lines, int *n_lines, int *max_lines, const char *buf, size_t len)
+{
+	for(size_t c = 0; c < len;)
+	{
+		const char *end = line_end(buf + c, buf + len);
+
+		if(*n_lines == *max_lines)
+		{
+			if(*max_lines > INT_MAX / 2)
+			{
+				return ERROR_FAILED_RESIZE;
+			}
+
+			int max = *max_lines ? *max_lines * 2 : 256;
+			struct index_line *grown = lal_realloc(LAL_MEM_INDEX, *lines, sizeof(struct index_line) * (size_t)max);
+
+			if(!grown)
+			{
+				return ERROR_FAILED_RESIZE;
+			}
+
+			*lines = grown;
+			*max_lines = max;
+		}
+
+		(*lines)[*n_lines].data = buf + c;
+		(*lines)[*n_lines].len = (size_t)(end - (buf + c));
+		(*n_lines)++;
+
+		c = (size_t)(end - buf) + 1;
+	}
+
+	return ERROR_NONE;
+}
+
+static int write_lines(FILE *out, struct index_line *lines, int n_lines)
+{
+	for(int k = 0; k < n_lines; k++)
+	{
+		if(fwrite(lines[k].data, sizeof(char), lines[k].len, out) != lines[k].len || fputc('\n', out) == EOF)
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static enum error_code write_index(const char *root, const char *ignore_stamp, struct index_line *aliases, int n_aliases, struct index_line *dirs, int n_dirs)
+{
+	char path[PATH_MAX];
+	char tmp[PATH_MAX];
+
+	if(!join_path(path, root, INDEX_FILE) || snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= sizeof(tmp))
+	{
+		return ERROR_FAILED_INDEX;
+	}
+
+	FILE *out = fopen(tmp, "wb");
+
+	if(!out)
+	{
+		return ERROR_FAILED_INDEX;
+	}
+
+	// the offset is fixed width so it can be filled in once the aliases are written
+	int ok = fprintf(out, "%s%s\t%0*d\n", INDEX_MAGIC, ignore_stamp, INDEX_OFFSET_WIDTH, 0) > 0 && write_lines(out, aliases, n_aliases);
+	long dirs_offset = ftell(out);
+
+	ok = ok && dirs_offset > 0 && write_lines(out, dirs, n_dirs);
+	ok = ok && fseek(out, strlen(INDEX_MAGIC) + strlen(ignore_stamp) + 1, SEEK_SET) == 0;
+	ok = ok && fprintf(out, "%0*ld", INDEX_OFFSET_WIDTH, dirs_offset) == INDEX_OFFSET_WIDTH;
+
+	if(fclose(out) != 0 || !ok || rename(tmp, path) != 0)
+	{
+		unlink(tmp);
+
+		return ERROR_FAILED_INDEX;
+	}
+
+	return ERROR_NONE;
+}
+
+// old records for .lal files that did not change carry over without being parsed again
+static enum error_code keep_old_aliases(struct old_index *old, struct index_line *kept, int n_kept, struct index_line **aliases, int *n_aliases, int *max_aliases)
+{
+	if(old->data == NULL || n_kept == 0)
+	{
+		return ERROR_NONE;
+	}
+
+	qsort(kept, n_kept, sizeof(struct index_line), compare_lines);
+
+	for(const char *line = old->aliases; line < old->dirs;)
+	{
+		const char *end = line_end(line, old->dirs);
+		arg_v file = line_field(line, end, 1);
+		struct index_line key = { file.data, file.len };
+
+		if(bsearch(&key, kept, n_kept, sizeof(struct index_line), compare_lines))
+		{
+			enum error_code e = collect_lines(aliases, n_aliases, max_aliases, line, end - line);
+
+			if(e != ERROR_NONE)
+			{
+				return e;
+			}
+		}
+
+		line = end + 1;
+	}
+
+	return ERROR_NONE;
+}
+
+static void count_files(struct index_line *aliases, int n_aliases, struct index_counts *counts)
+{
+	struct index_line *files = lal_malloc(LAL_MEM_INDEX, sizeof(struct index_line) * (n_aliases > 0 ? n_aliases : 1));
+
+	counts->aliases = n_aliases;
+	counts->files = 0;
+
+	if(!files)
+	{
+		return;
+	}
+
+	for(int k = 0; k < n_aliases; k++)
+	{
+		arg_v file = line_field(aliases[k].data, aliases[k].data + aliases[k].len, 1);
+
+		files[k].data = file.data;
+		files[k].len = file.len;
+	}
+
+	qsort(files, n_aliases, sizeof(struct index_line), compare_lines);
+
+	for(int k = 0; k < n_aliases; k++)
+	{
+		counts->files += k == 0 || compare_lines(&files[k - 1], &files[k]) != 0;
+	}
+
+	lal_free(LAL_MEM_INDEX, files);
+}
+
+enum error_code index_tree(const char *root, struct index_counts *counts)
+{
+	struct stat st;
+
+	if(stat(root, &st) != 0 || !S_ISDIR(st.st_mode))
+	{
+		return ERROR_NO_FILE;
+	}
+
+	struct crawl crawl;
+	struct old_index old;
+	char path[PATH_MAX];
+	char ignore_stamp[INDEX_STAMP_SIZE] = INDEX_NO_STAMP;
+	char *ignore_contents = NULL;
+
+	memset(&crawl, 0, sizeof(crawl));
+	crawl.root = root;
+	crawl.old = &old;
+
+	if(!join_path(path, root, INDEX_IGNORE_FILE))
+	{
+		return ERROR_NO_FILE;
+	}
+
+	FILE *ignore = fopen(path, "rb");
+
+	if(ignore)
+	{
+		fstat(fileno(ignore), &st);
+		format_stat(ignore_stamp, &st);
+
+		ignore_contents = lal_calloc(LAL_MEM_INDEX, st.st_size + 1, sizeof(char));
+
+		if(!ignore_contents || fread(ignore_contents, sizeof(char), st.st_size, ignore) != st.st_size || load_ignores(&crawl, ignore_contents) != ERROR_NONE)
+		{
+			fclose(ignore);
+			lal_free(LAL_MEM_INDEX, ignore_contents);
+			lal_free(LAL_MEM_INDEX, crawl.ignores);
+
+			return ERROR_FAILED_READ;
+		}
+
+		fclose(ignore);
+	}
+
+	if(!join_path(path, root, INDEX_FILE))
+	{
+		return ERROR_NO_FILE;
+	}
+
+	load_old_index(&old, path, ignore_stamp);
+
+	long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	struct crawl_worker workers[INDEX_MAX_THREADS];
+
+	crawl.n_queues = n_cpus < 1 ? 1 : n_cpus > INDEX_MAX_THREADS ? INDEX_MAX_THREADS : n_cpus;
+	atomic_init(&crawl.pending, 0);
+	atomic_init(&crawl.pushes, 0);
+	atomic_init(&crawl.sleepers, 0);
+	pthread_mutex_init(&crawl.idle_lock, NULL);
+	pthread_cond_init(&crawl.idle, NULL);
+
+	for(int k = 0; k < crawl.n_queues; k++)
+	{
+		pthread_mutex_init(&crawl.queues[k].lock, NULL);
+
+		workers[k].crawl = &crawl;
+		workers[k].id = k;
+		workers[k].dirs_read = 0;
+		workers[k].files_read = 0;
+		workers[k].error = ERROR_NONE;
+		char_v_init(&workers[k].aliases);
+		char_v_init(&workers[k].dirs);
+		char_v_init(&workers[k].kept);
+	}
+
+	enum error_code error = push_dir(&workers[0], ".", 1);
+	int started = 1;
+
+	// the calling thread is worker 0; a queue whose thread could not start is emptied by the others stealing
+	for(; error == ERROR_NONE && started < crawl.n_queues; started++)
+	{
+		if(pthread_create(&workers[started].thread, NULL, crawl_worker, &workers[started]) != 0)
+		{
+			break;
+		}
+	}
+
+	if(error == ERROR_NONE)
+	{
+		crawl_worker(&workers[0]);
+	}
+
+	for(int k = 1; k < started; k++)
+	{
+		pthread_join(workers[k].thread, NULL);
+	}
+
+	struct index_line *aliases = NULL;
+	struct index_line *dirs = NULL;
+	struct index_line *kept = NULL;
+	int n_aliases = 0, max_aliases = 0;
+	int n_dirs = 0, max_dirs = 0;
+	int n_kept = 0, max_kept = 0;
+
+	memset(counts, 0, sizeof(*counts));
+
+	for(int k = 0; k < crawl.n_queues; k++)
+	{
+		if(error == ERROR_NONE)
+		{
+			error = workers[k].error;
+		}
+
+		if(error == ERROR_NONE)
+		{
+			error = collect_lines(&aliases, &n_aliases, &max_aliases, char_v_data(&workers[k].aliases), workers[k].aliases.len);
+		}
+
+		if(error == ERROR_NONE)
+		{
+			error = collect_lines(&dirs, &n_dirs, &max_dirs, char_v_data(&workers[k].dirs), workers[k].dirs.len);
+		}
+
+		if(error == ERROR_NONE)
+		{
+			error = collect_lines(&kept, &n_kept, &max_kept, char_v_data(&workers[k].kept), workers[k].kept.len);
+		}
+
+		counts->dirs_read += workers[k].dirs_read;
+		counts->files_read += workers[k].files_read;
+	}
+
+	if(error == ERROR_NONE)
+	{
+		error = keep_old_aliases(&old, kept, n_kept, &aliases, &n_aliases, &max_aliases);
+	}
+
+	if(error == ERROR_NONE)
+	{
+		qsort(aliases, n_aliases, sizeof(struct index_line), compare_lines);
+		qsort(dirs, n_dirs, sizeof(struct index_line), compare_lines);
+
+		error = write_index(root, ignore_stamp, aliases, n_aliases, dirs, n_dirs);
+
+		count_files(aliases, n_aliases, counts);
+		counts->dirs = n_dirs;
+	}
+
+	lal_free(LAL_MEM_INDEX, aliases);
+	lal_free(LAL_MEM_INDEX, dirs);
+	lal_free(LAL_MEM_INDEX, kept);
+
+	// the old records are only unmapped once nothing points into them
+	free_old_index(&old);
+
+	pthread_mutex_destroy(&crawl.idle_lock);
+	pthread_cond_destroy(&crawl.idle);
+
+	for(int k = 0; k < crawl.n_queues; k++)
+	{
+		pthread_mutex_destroy(&crawl.queues[k].lock);
+		lal_free(LAL_MEM_INDEX, crawl.queues[k].paths);
+		char_v_release(&workers[k].aliases);
+		char_v_release(&workers[k].dirs);
+		char_v_release(&workers[k].kept);
+	}
+
+	lal_free(LAL_MEM_INDEX, crawl.ignores);
+	lal_free(LAL_MEM_INDEX, ignore_contents);
+
+	return error;
+}
+
+// prefix is "", "../", "../../" and so on up to the filesystem root
+static int open_nearest_index(char *prefix, int size)
+{
+	prefix[0] = '\0';
+
+	while(1)
+	{
+		char path[PATH_MAX];
+		struct stat here;
+		struct stat parent;
+
+		snprintf(path, sizeof(path), "%s" INDEX_FILE, prefix);
+
+		int fd = open(path, O_RDONLY);
+
+		if(fd >= 0)
+		{
+			return fd;
+		}
+
+		snprintf(path, sizeof(path), "%s.", prefix);
+
+		if(stat(path, &here) != 0)
+		{
+			return -1;
+		}
+
+		snprintf(path, sizeof(path), "%s..", prefix);
+
+		if(stat(path, &parent) != 0 || (here.st_dev == parent.st_dev && here.st_ino == parent.st_ino) || strlen(prefix) + strlen("../") >= size)
+		{
+			return -1;
+		}
+
+		strcat(prefix, "../");
+	}
+}
+
+enum error_code index_find(char_v *out, const char *name, size_t len)
+{
+	char prefix[PATH_MAX];
+	int fd = open_nearest_index(prefix, sizeof(prefix));
+	struct stat st;
+
+	if(fd < 0)
+	{
+		return ERROR_NO_INDEX;
+	}
+
+	if(fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		close(fd);
+
+		return ERROR_BAD_INDEX;
+	}
+
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if(data == MAP_FAILED)
+	{
+		return ERROR_FAILED_READ;
+	}
+
+	const char *end = (const char *)data + st.st_size;
+	const char *header_end = line_end(data, end);
+	arg_v offset = line_field(data, end, 2);
+	long long dirs_offset = offset.len == INDEX_OFFSET_WIDTH ? atoll(offset.data) : -1;
+
+	if(header_end == end || strncmp(data, INDEX_MAGIC, strlen(INDEX_MAGIC)) != 0 || dirs_offset <= header_end - (const char *)data || dirs_offset > st.st_size)
+	{
+		munmap(data, st.st_size);
+
+		return ERROR_BAD_INDEX;
+	}
+
+	const char *dirs = (const char *)data + dirs_offset;
+	char_v *key = init_char_v();
+
+	if(!key || !append_escaped(key, name, len))
+	{
+		if(key)
+		{
+			free_char_v(key);
+		}
+
+		munmap(data, st.st_size);
+
+		return ERROR_FAILED_RESIZE;
+	}
+
+	enum error_code error = ERROR_LABEL_NOT_FOUND;
+	arg_v key_field = { char_v_data(key), key->len };
+
+	for(const char *line = lower_bound(header_end + 1, dirs, key_field); line < dirs;)
+	{
+		const char *stop = line_end(line, dirs);
+
+		if(compare_keys(line_field(line, stop, 0), key_field) != 0)
+		{
+			break;
+		}
+
+		int ok = char_v_append_str(out, prefix) && append_unescaped(out, line_field(line, stop, 1)) && char_v_append_str(out, ": ");
+
+		if(!(ok && append_unescaped(out, line_field(line, stop, 3)) && char_v_append(out, '\n')))
+		{
+			error = ERROR_FAILED_RESIZE;
+			break;
+		}
+
+		error = ERROR_NONE;
+		line = stop + 1;
+	}
+
+	free_char_v(key);
+	munmap(data, st.st_size);
+
+	return error;
+}
@@ -0,0 +1,23 @@
+#include <stddef.h>
+
+#include "liblalias.h"
+
+#define INDEX_FILE ".lal_index"
+#define INDEX_IGNORE_FILE ".lalignore"
+
+struct char_v;
+
+struct index_counts
+{
+	int aliases;
+	int files;
+	int dirs;
+	int dirs_read; // the rest were unchanged since the last index
+	int files_read;
+};
+
+// crawls root for .lal files into root/.lal_index, reading only directories and files that changed since the last run
+enum error_code index_tree(const char *root, struct index_counts *counts);
+
+// every definition of name in the nearest .lal_index at or above the working directory, one "file: definition" per line
+enum error_code index_find(struct char_v *out, const char *name, size_t len);
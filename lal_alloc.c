@@ -0,0 +1,135 @@
+#include <malloc.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "lal_alloc.h"
+
+struct mem_counters
+{
+	atomic_long allocs;
+	atomic_long reallocs;
+	atomic_long frees;
+	atomic_long requested; // over the whole run
+	atomic_long live; // bytes as the allocator sized them
+	atomic_long peak;
+};
+
+static struct mem_counters counters[LAL_MEM_CATEGORIES];
+// kept apart, the categories peak at different times
+static struct mem_counters total;
+
+static const char *category_names[LAL_MEM_CATEGORIES] = {
+	"string",
+	"pool",
+	"node",
+	"file",
+	"commands",
+	"exec",
+	"stats",
+	"index",
+	"library",
+};
+
+static void raise_peak(atomic_long *peak, long live)
+{
+	long seen = atomic_load_explicit(peak, memory_order_relaxed);
+
+	while(live > seen && !atomic_compare_exchange_weak_explicit(peak, &seen, live, memory_order_relaxed, memory_order_relaxed))
+	{
+	}
+}
+
+static void count_live(enum lal_mem_category category, long delta)
+{
+	long live = atomic_fetch_add_explicit(&counters[category].live, delta, memory_order_relaxed) + delta;
+
+	raise_peak(&counters[category].peak, live);
+
+	live = atomic_fetch_add_explicit(&total.live, delta, memory_order_relaxed) + delta;
+
+	raise_peak(&total.peak, live);
+}
+
+static void count(atomic_long *category_counter, atomic_long *total_counter, long n)
+{
+	atomic_fetch_add_explicit(category_counter, n, memory_order_relaxed);
+	atomic_fetch_add_explicit(total_counter, n, memory_order_relaxed);
+}
+
+void *lal_malloc(enum lal_mem_category category, size_t size)
+{
+	void *ptr = malloc(size);
+
+	if(ptr)
+	{
+		count(&counters[category].allocs, &total.allocs, 1);
+		count(&counters[category].requested, &total.requested, (long)size);
+		count_live(category, (long)malloc_usable_size(ptr));
+	}
+
+	return ptr;
+}
+
+void *lal_calloc(enum lal_mem_category category, size_t n, size_t size)
+{
+	void *ptr = calloc(n, size);
+
+	if(ptr)
+	{
+		// calloc has already refused an n * size that overflows
+		count(&counters[category].allocs, &total.allocs, 1);
+		count(&counters[category].requested, &total.requested, (long)(n * size));
+		count_live(category, (long)malloc_usable_size(ptr));
+	}
+
+	return ptr;
+}
+
+void *lal_realloc(enum lal_mem_category category, void *ptr, size_t size)
+{
+	size_t old = ptr ? malloc_usable_size(ptr) : 0;
+	void *grown = realloc(ptr, size);
+
+	if(grown)
+	{
+		count(ptr ? &counters[category].reallocs : &counters[category].allocs, ptr ? &total.reallocs : &total.allocs, 1);
+		count(&counters[category].requested, &total.requested, (long)size);
+		count_live(category, (long)malloc_usable_size(grown) - (long)old);
+	}
+
+	return grown;
+}
+
+void lal_free(enum lal_mem_category category, void *ptr)
+{
+	if(!ptr)
+	{
+		return;
+	}
+
+	count(&counters[category].frees, &total.frees, 1);
+	count_live(category, -(long)malloc_usable_size(ptr));
+	free(ptr);
+}
+
+static void report_row(FILE *out, const char *name, struct mem_counters *c)
+{
+	fprintf(out, "%-10s %10ld %10ld %10ld %14ld %12ld %12ld\n", name,
+		atomic_load(&c->allocs), atomic_load(&c->reallocs), atomic_load(&c->frees),
+		atomic_load(&c->requested), atomic_load(&c->live), atomic_load(&c->peak));
+}
+
+void lal_mem_report(FILE *out)
+{
+	fprintf(out, "%-10s %10s %10s %10s %14s %12s %12s\n", "memory", "allocs", "reallocs", "frees", "requested", "live", "peak");
+
+	for(int k = 0; k < LAL_MEM_CATEGORIES; k++)
+	{
+		if(atomic_load(&counters[k].allocs) > 0)
+		{
+			report_row(out, category_names[k], &counters[k]);
+		}
+	}
+
+	report_row(out, "total", &total);
+}
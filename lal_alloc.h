@@ -0,0 +1,32 @@
+#ifndef LAL_ALLOC_H
+#define LAL_ALLOC_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// every allocation lalias makes itself goes through here, tagged with what it is for, so --mem-report can show where memory goes
+// memory handed out by libc (getline, getcwd) is freed with plain free and never counted
+enum lal_mem_category
+{
+	LAL_MEM_STRING, // char_v buffers
+	LAL_MEM_POOL, // interned names and fragments
+	LAL_MEM_NODE, // alias nodes and their component arrays
+	LAL_MEM_FILE, // a .lal read whole
+	LAL_MEM_COMMANDS, // parsed arguments and per-run arrays
+	LAL_MEM_EXEC, // in-process builtins
+	LAL_MEM_STATS,
+	LAL_MEM_INDEX,
+	LAL_MEM_LIBRARY, // liblalias handles, snapshots and results
+	LAL_MEM_CATEGORIES
+};
+
+// the same as malloc, calloc, realloc and free; a pointer is freed or grown under the category it was allocated with
+void *lal_malloc(enum lal_mem_category category, size_t size);
+void *lal_calloc(enum lal_mem_category category, size_t n, size_t size);
+void *lal_realloc(enum lal_mem_category category, void *ptr, size_t size);
+void lal_free(enum lal_mem_category category, void *ptr);
+
+// one row per category and a total; live is what is still allocated, so 0 after a full teardown
+void lal_mem_report(FILE *out);
+
+#endif
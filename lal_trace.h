@@ -0,0 +1,32 @@
+#ifndef LAL_TRACE_H
+#define LAL_TRACE_H
+
+// USDT probes under the "lalias" provider, for perf, bpftrace and the like:
+//   file_load(size, sorted)              a .lal is opened; sorted is 1 when only one record will be parsed
+//   alias_parsed(name, name_len, n_components)
+//   lookup(name, name_len, hit)          a name looked up in a parsed table or snapshot
+//   sorted_search(name, name_len, hit)   a sorted .lal searched for one record; a hit is followed by its lookup
+//   edit(op, name, name_len)             op is "append", "truncate", "delete" or "rename"
+//   line_spawn(pid, command)             command nul-terminated
+//   line_done(pid, status, wall_us)      pid is 0 for a line run in-process, status as from wait
+// e.g. bpftrace -e 'usdt:./lalias:lalias:line_done { @us = hist(arg2); }'
+//
+// each probe is a single nop until something attaches; without <sys/sdt.h>, or with LAL_NO_TRACE, they compile to nothing
+// the Makefile notes a build without <sys/sdt.h>, and make trace-check fails on one
+
+#if !defined(LAL_NO_TRACE) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define LAL_TRACE_ENABLED
+#endif
+#endif
+
+#ifdef LAL_TRACE_ENABLED
+#define LAL_TRACE2(probe, a, b) DTRACE_PROBE2(lalias, probe, a, b)
+#define LAL_TRACE3(probe, a, b, c) DTRACE_PROBE3(lalias, probe, a, b, c)
+#else
+#define LAL_TRACE2(probe, a, b) do { } while(0)
+#define LAL_TRACE3(probe, a, b, c) do { } while(0)
+#endif
+
+#endif
@@ -1,108 +1,110 @@
+#include <errno.h>
+#include <stdatomic.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
 #include "lalias.h"
-
-typedef int bool;
-
-#define TRUE (bool)1
-#define FALSE (bool)0
+#include "lal_alloc.h"
+#include "lal_trace.h"
 
 #define INITIAL_VECTOR_SIZE 32
 
-enum error_code
-{
-	ERROR_INPUT_OVERFLOW,
-	ERROR_FAILED_RESIZE,
-	ERROR_UNKNOWN_FLAG,
-	ERROR_NO_INPUT,
-	ERROR_NO_LABEL,
-	ERROR_NO_LAL,
-	ERROR_FAILED_READ,
-	ERROR_UNEXPECTED_EOF,
-	ERROR_INVALID_CHARACTERS_IN_LABEL,
-	ERROR_NO_NAME,
-	ERROR_NO_COMMAND,
-	ERROR_NO_FILE,
-	ERROR_INSUFFICIENT_INPUTS,
-	ERROR_BAD_NUMERICAL_INPUT,
-	ERROR_FAILED_TO_TRUNCATE,
-	ERROR_LABEL_NOT_FOUND,
-	ERROR_LAL_REWRITE_FAILURE
-};
+// below this a single thread parses faster than several can be started
+#define PARALLEL_PARSE_MIN_SIZE (1 << 20)
+#define PARALLEL_PARSE_MIN_CHUNK (256 << 10)
+#define PARALLEL_PARSE_MAX_THREADS 16
+
+// sharded so parse_parallel's threads rarely wait on each other
+#define POOL_SHARDS 16
+#define POOL_BLOCK_SIZE (64 << 10)
+#define POOL_INITIAL_SLOTS 256
 
-void lal_error(enum error_code code)
+const char *lal_strerror(enum error_code code)
 {
-	switch (code) 
+	switch (code)
 	{
-		case ERROR_INPUT_OVERFLOW:
-			printf("ERROR: Input contains too many subcommands.\n");
-			exit(1);
+		case ERROR_NONE:
+			return "No error.";
 		case ERROR_FAILED_RESIZE:
-			printf("ERROR: Failed to resize char_v, unable to complete command.\n");
-			exit(1);
+			return "Failed to resize char_v, unable to complete command.";
 		case ERROR_UNKNOWN_FLAG:
-			printf("ERROR: Unknown flag.\n");
-			exit(1);
+			return "Unknown flag.";
 		case ERROR_NO_INPUT:
-			printf("ERROR: No input.\n");
-			exit(1);
+			return "No input.";
 		case ERROR_NO_LABEL:
-			printf("ERROR: No label.\n");
-			exit(1);
+			return "No label.";
 		case ERROR_NO_LAL:
-			printf("ERROR: No .lal file exists.\n");
-			exit(1);
+			return "No .lal file exists.";
 		case ERROR_FAILED_READ:
-			printf("ERROR: Failed to read .lal.\n");
-			exit(1);
+			return "Failed to read .lal.";
 		case ERROR_UNEXPECTED_EOF:
-			printf("ERROR: Unexpected END OF FILE in .lal.\n");
-			exit(1);
+			return "Unexpected END OF FILE in .lal.";
 		case ERROR_INVALID_CHARACTERS_IN_LABEL:
-			printf("ERROR: Restricted characters in label(s) in .lal.\n");
-			exit(1);	
+			return "Restricted characters in label(s) in .lal.";
 		case ERROR_NO_NAME:
-			printf("ERROR: Error occurred when parsing rule name.\n");
-			exit(1);
+			return "Error occurred when parsing rule name.";
 		case ERROR_NO_COMMAND:
-			printf("ERROR: Error occurred when parsing rule command.\n");
-			exit(1);
+			return "Error occurred when parsing rule command.";
 		case ERROR_NO_FILE:
-			printf("ERROR: File inputted not found.\n");
-			exit(1);
+			return "File inputted not found.";
 		case ERROR_INSUFFICIENT_INPUTS:
-			printf("ERROR: Insufficient amount of inputs.\n");
-			exit(1);
+			return "Insufficient amount of inputs.";
 		case ERROR_BAD_NUMERICAL_INPUT:
-			printf("ERROR: Unexpected characters in positive integer input.\n");
-			exit(1);
+			return "Unexpected characters in positive integer input.";
 		case ERROR_FAILED_TO_TRUNCATE:
-			printf("ERROR: Failed to truncate label, insufficient or improperly formatted lines.\n");
-			exit(1);
+			return "Failed to truncate label, insufficient or improperly formatted lines.";
 		case ERROR_LABEL_NOT_FOUND:
-			printf("ERROR: Inputted label not found.\n");
-			exit(1);
+			return "Inputted label not found.";
 		case ERROR_LAL_REWRITE_FAILURE:
-			printf("ERROR: Unexpected issues during rewrite of .lal file.\n");
-			exit(1);
-	}
+			return "Unexpected issues during rewrite of .lal file.";
+		case ERROR_FAILED_SPAWN:
+			return "Failed to spawn command.";
+		case ERROR_FAILED_STATS_READ:
+			return "Failed to read .lal_stats.";
+		case ERROR_BAD_DIRECTIVE:
+			return "Unknown or malformed <<@...>> directive.";
+		case ERROR_FAILED_COMPILE:
+			return "Failed to write .lal_cache.";
+		case ERROR_UNKNOWN_SHELL:
+			return "Unknown shell, expected bash, zsh or fish.";
+		case ERROR_BAD_GUARD:
+			return "Unknown or malformed <<?...>> guard.";
+		case ERROR_NO_INDEX:
+			return "No .lal_index here or above, run lalias --index first.";
+		case ERROR_BAD_INDEX:
+			return "Malformed .lal_index, rerun lalias --index.";
+		case ERROR_FAILED_INDEX:
+			return "Failed to write .lal_index.";
+		case ERROR_LABEL_EXISTS:
+			return "An alias with the new name already exists.";
+	}
+
+	return "Unknown error.";
 }
 
-int nn_int_from_str(char *str, int len)
+int nn_int_from_str(const char *str, size_t len)
 {
 	int n = 0;
 
-	for(int i = 0; i < len; i++)
+	for(size_t i = 0; i < len; i++)
 	{
 		if(str[i] < '0' || str[i] > '9')
 		{
 			return -1;
 		}
 
+		if(n > (INT_MAX - (str[i] - '0')) / 10)
+		{
+			return -1;
+		}
+
 		n *= 10;
 		n += str[i] - '0';
 	}
@@ -110,14 +112,14 @@ int nn_int_from_str(char *str, int len)
 	return n;
 }
 
-bool safe_compare(char *buf, int index, int len, off_t size, const char *str)
+bool safe_compare(const char *buf, off_t index, size_t len, off_t size, const char *str)
 {
-	if(index + len > size)
+	if(index > size || len > (size_t)(size - index))
 	{
 		return FALSE;
 	}
 
-	for(int i = 0; i < len; i++)
+	for(size_t i = 0; i < len; i++)
 	{
 		if(buf[index + i] != str[i])
 		{
@@ -135,942 +137,2343 @@ bool compare_char_v(char_v *v1, char_v *v2)
 		return FALSE;
 	}
 
-	for(int i = 0; i < v1->len; i++)
+	// two strings interned in one pool are equal only at one address, but each parse has its own pool
+	if(char_v_data(v1) == char_v_data(v2))
 	{
-		if(v1->data[i] != v2->data[i])
-		{
-			return FALSE;
-		}
+		return TRUE;
 	}
 
-	return TRUE;
+	return memcmp(char_v_data(v1), char_v_data(v2), v1->len) == 0;
 }
 
-char_v *init_char_v()
+bool compare_arg_v(arg_v a, char_v *v)
 {
-	char_v *vector = malloc(sizeof(char_v));
-
-	vector->data = malloc(INITIAL_VECTOR_SIZE);
-	vector->max = INITIAL_VECTOR_SIZE;
-	vector->len = 0;
+	if(a.len != v->len)
+	{
+		return FALSE;
+	}
 
-	return vector;
+	return memcmp(a.data, char_v_data(v), a.len) == 0;
 }
 
-void free_char_v(char_v *v)
+void char_v_init(char_v *v)
 {
-	free(v->data);
-	free(v);
+	v->max = CHAR_V_INLINE_SIZE;
+	v->len = 0;
 }
 
-int char_v_append(char_v *vec, char c)
+void char_v_release(char_v *v)
 {
-	if(vec->len >= vec->max)
+	if(v->max > CHAR_V_INLINE_SIZE)
 	{
-		vec->data = realloc(vec->data, vec->max * 2 * sizeof(char));
-		vec->max *= 2;
-
-		if(!vec->data)
-		{
-			return 0;
-		}
+		lal_free(LAL_MEM_STRING, v->heap);
 	}
 
-	vec->data[vec->len] = c;
-	vec->len++;
-
-	return 1;
+	char_v_init(v);
 }
 
-char_v *copy_char_v(char_v *v)
+char_v *init_char_v()
 {
-	char_v *copy = init_char_v();
+	char_v *vector = lal_malloc(LAL_MEM_STRING, sizeof(char_v));
 
-	for(int i = 0; i < v->len; i++)
+	if(vector)
 	{
-		if(char_v_append(copy, v->data[i]) == 0)
-		{
-			lal_error(ERROR_FAILED_RESIZE);
-		}
+		char_v_init(vector);
 	}
 
-	return copy;
+	return vector;
 }
 
-void print_char_v(char_v v)
+void free_char_v(char_v *v)
 {
-	for(int i = 0; i < v.len; i++)
-	{
-		printf("%c", v.data[i]);
-	}
+	char_v_release(v);
+	lal_free(LAL_MEM_STRING, v);
 }
 
-void print_nodes(alias_node *nodes)
+// fails rather than wrap when len + extra would not fit in a size_t
+int char_v_reserve(char_v *vec, size_t extra)
 {
-	for(alias_node *node = nodes; node != NULL; node = node->next_node)
+	if(extra > SIZE_MAX - vec->len)
 	{
-		print_char_v(*node->name);
-
-		for(int i = 0; i < node->components_len; i++)
-		{
-			if(node->components[i].type == LAL_NEW_LINE)
-			{
-				printf("\n");
-			}
-			else if(node->components[i].type == LAL_END)
-			{
-				printf("\n<<END>>");
-			}
-			else if(node->components[i].type == LAL_PLAIN)
-			{
-				print_char_v(*node->components[i].contents);
-			}
-			else if(node->components[i].type == LAL_ARG)
-			{
-				printf("<<");
-				print_char_v(*node->components[i].contents);
-				printf(">>");
-			}
-		}
-
-		printf("\n");
+		return 0;
 	}
-}
 
-commands *parse_inputs(int argc, char *argv[])
-{
-	if(argc > MAX_SUB_CMDS)
+	size_t need = vec->len + extra;
+
+	if(need <= vec->max)
 	{
-		lal_error(ERROR_INPUT_OVERFLOW);
+		return 1;
 	}
 
-	commands *cmd = malloc(sizeof(commands));
-	cmd->n_cmds = 0;
+	size_t max = vec->max < INITIAL_VECTOR_SIZE ? INITIAL_VECTOR_SIZE : vec->max;
 
-	if(argc == 1)
+	while(max < need)
 	{
-		cmd->sub_cmds[0].type = EMPTY;
-		cmd->sub_cmds[0].contents = NULL;
-
-		return cmd;
+		max = max > SIZE_MAX / 2 ? need : max * 2;
 	}
 
-	for(int i = 1; i < argc; i++)
+	if(vec->max > CHAR_V_INLINE_SIZE)
 	{
-		cmd->sub_cmds[i - 1].contents = init_char_v();
-		int offset = 0;
+		char *data = lal_realloc(LAL_MEM_STRING, vec->heap, max * sizeof(char));
 
-		if(i == 1 && argv[i][0] == '-')
+		if(!data)
 		{
-			offset = 1;
-
-			cmd->sub_cmds[i - 1].type = FLAG;
-		}
-		else 
-		{
-			offset = 0;
-			cmd->sub_cmds[i - 1].type = INPUT;
-		}
-
-		for(int j = 0; j < strlen(argv[i]) - offset; j++)
-		{
-			char_v_append(cmd->sub_cmds[i - 1].contents, argv[i][j + offset]);
+			return 0;
 		}
 
-		cmd->n_cmds++;
+		vec->heap = data;
 	}
-
-	for(int i = 0; i < cmd->n_cmds; i++)
+	else 
 	{
-		switch(cmd->sub_cmds[i].type)
+		char *data = lal_malloc(LAL_MEM_STRING, max * sizeof(char));
+
+		if(!data)
 		{
-			case INPUT:
-				printf("\"");
-				print_char_v(*cmd->sub_cmds[i].contents);
-				printf("\"");
-				break;
-			case FLAG:
-				printf("-");
-				print_char_v(*cmd->sub_cmds[i].contents);
-				break;
-			case EMPTY:
-				printf("<<EMPTY>>");
-				break;
+			return 0;
 		}
 
-		printf(" ");
+		memcpy(data, char_v_data(vec), vec->len);
+		vec->heap = data;
 	}
 
-	printf("\n");
+	vec->max = max;
 
-	return cmd;
+	return 1;
 }
 
-off_t fsize(const char *file_name)
+int char_v_append(char_v *vec, char c)
 {
-	struct stat s;
-	int e = stat(file_name, &s);
-
-	if(e == 0)
+	if(vec->len >= vec->max && char_v_reserve(vec, 1) == 0)
 	{
-		return s.st_size;
+		return 0;
 	}
 
-	lal_error(ERROR_FAILED_READ);
+	char_v_data(vec)[vec->len] = c;
+	vec->len++;
 
-	return -1;
+	return 1;
 }
 
-bool is_restricted(char c)
+int char_v_append_n(char_v *vec, const char *src, size_t n)
 {
-	for(int i = 0; i < strlen(RESTRICTED_NAME_CHARACTERS); i++)
+	if(char_v_reserve(vec, n) == 0)
 	{
-		if(c == RESTRICTED_NAME_CHARACTERS[i])
-		{
-			return TRUE;
-		}
+		return 0;
 	}
 
-	return FALSE;
+	memcpy(char_v_data(vec) + vec->len, src, n);
+	vec->len += n;
+
+	return 1;
 }
 
-int parse_name(alias_node *label, char *contents, int *index, off_t size)
+int char_v_copy(char_v *copy, char_v *v)
 {
-	label->name = init_char_v();
+	char_v_init(copy);
 
-	while(contents[*index] != ':')
-	{
-		if(is_restricted(contents[*index]))
-		{
-			lal_error(ERROR_INVALID_CHARACTERS_IN_LABEL);
-		}
-
-		if(*index >= size)
-		{
-			return 0;
-		}
-
-		char_v_append(label->name, contents[*index]);
+	return char_v_append_n(copy, char_v_data(v), v->len);
+}
 
-		(*index)++;
-	}
+int char_v_from_arg_v(char_v *copy, arg_v a)
+{
+	char_v_init(copy);
 
-	return 1;
+	return char_v_append_n(copy, a.data, a.len);
 }
 
-int parse_inner(alias_node *label, char *contents, int *index, off_t size)
+struct pool_block
 {
-	if(safe_compare(contents, *index, strlen("<<"), size, "<<"))
-	{
-		*index += strlen("<<");
-
-		label->components_len++;
-		label->components[label->components_len - 1].type = LAL_ARG;
-		label->components[label->components_len - 1].contents = init_char_v();
-		int depth = 1;
+	struct pool_block *next;
+	size_t used;
+	size_t size;
+	char data[];
+};
 
-		while(depth > 0)
-		{
-			int jump = 1;
+struct pool_slot
+{
+	const char *data; // NULL for an empty slot
+	size_t len;
+	uint32_t hash;
+};
 
-			if(safe_compare(contents, *index, strlen("<<"), size, "<<"))
-			{
-				depth++;
-				jump = strlen("<<");
-			}
-			else if(safe_compare(contents, *index, strlen(">>"), size, ">>"))
-			{
-				depth--;
-				jump = strlen(">>");
-			}
+struct pool_shard
+{
+	pthread_mutex_t lock;
+	struct pool_slot *slots;
+	size_t n_slots; // a power of two
+	size_t n_strings;
+	struct pool_block *blocks; // the first is the one being filled
+};
 
-			if(depth > 0)
-			{
-				char_v_append(label->components[label->components_len - 1].contents, contents[*index]);
-			}
+// each parse makes its own, and every node of the list it builds holds a reference, so the pool goes with the last of them
+struct string_pool
+{
+	atomic_int refs;
+	struct pool_shard shards[POOL_SHARDS];
+};
 
-			*index += jump;
+string_pool *string_pool_create()
+{
+	string_pool *pool = lal_calloc(LAL_MEM_POOL, 1, sizeof(string_pool));
 
-			if(*index >= size)
-			{
-				return 0;
-			}
-		}
-	}
-	else 
+	if(pool)
 	{
-		if(label->components_len == 0 || label->components[label->components_len - 1].type != LAL_PLAIN)
+		atomic_init(&pool->refs, 1);
+
+		for(int s = 0; s < POOL_SHARDS; s++)
 		{
-			label->components_len++;
-			label->components[label->components_len - 1].type = LAL_PLAIN;
-			label->components[label->components_len - 1].contents = init_char_v();
+			pthread_mutex_init(&pool->shards[s].lock, NULL);
 		}
-
-		char_v_append(label->components[label->components_len - 1].contents, contents[*index]);
-		(*index)++;
 	}
 
-	return 1;
+	return pool;
 }
 
-int parse_line(alias_node *label, char *contents, int *index, off_t size)
+void string_pool_hold(string_pool *pool)
 {
-	if(safe_compare(contents, *index, strlen("{"), size, "{"))
-	{
-		*index += strlen("{");
+	atomic_fetch_add_explicit(&pool->refs, 1, memory_order_relaxed);
+}
 
-		label->components[label->components_len].type = LAL_NEW_LINE;
-		label->components[label->components_len].contents = NULL;
-		label->components_len++;
+void string_pool_release(string_pool *pool)
+{
+	if(!pool || atomic_fetch_sub_explicit(&pool->refs, 1, memory_order_acq_rel) != 1)
+	{
+		return;
+	}
 
-		int depth = 1;
+	for(int s = 0; s < POOL_SHARDS; s++)
+	{
+		struct pool_shard *shard = &pool->shards[s];
 
-		while(depth > 0)
+		while(shard->blocks)
 		{
-			if(safe_compare(contents, *index, strlen("{"), size, "{"))
-			{
-				depth++;
-				(*index)++;
-			}
-			else if(safe_compare(contents, *index, strlen("}"), size, "}"))
-			{
-				depth--;
-				(*index)++;
-			}
-
-			if(depth > 0)
-			{
-				if(parse_inner(label, contents, index, size) == 0)
-				{
-					lal_error(ERROR_NO_COMMAND);
-				}
-			}
+			struct pool_block *next = shard->blocks->next;
 
-			if(*index >= size)
-			{
-				return 0;
-			}
+			lal_free(LAL_MEM_POOL, shard->blocks);
+			shard->blocks = next;
 		}
 
-		label->components[label->components_len].type = LAL_END_LINE;
-		label->components[label->components_len].contents = NULL;
-		label->components_len++;
-	}
-	else 
-	{
-		(*index)++;
+		lal_free(LAL_MEM_POOL, shard->slots);
+		pthread_mutex_destroy(&shard->lock);
 	}
 
-	return 1;
+	lal_free(LAL_MEM_POOL, pool);
 }
 
-int parse_components(alias_node *label, char *contents, int *index, off_t size)
+uint32_t pool_hash(const char *str, size_t len)
 {
-	label->components_len = 0;
+	uint32_t h = 2166136261u;
 
-	while(!safe_compare(contents, *index, strlen("<<END>>"), size, "<<END>>"))
+	for(size_t i = 0; i < len; i++)
 	{
-		if(parse_line(label, contents, index, size) == 0)
-		{
-			lal_error(ERROR_NO_COMMAND);
-		}
-
-		if(*index >= size)
-		{
-			return 0;
-		}
+		h ^= (unsigned char)str[i];
+		h *= 16777619u;
 	}
 
-	*index += strlen("<<END>>");
-
-	label->components[label->components_len].type = LAL_END;
-	label->components_len++;
-
-	while(is_restricted(contents[*index]))
-	{
-		(*index)++;
-	}
+	return h;
+}
 
-	return 1;
+struct pool_shard *pool_shard_of(string_pool *pool, uint32_t hash)
+{
+	return &pool->shards[(hash >> 24) % POOL_SHARDS];
 }
 
-FILE *open_lal()
+// the slot holding str, or the empty one it would go in
+struct pool_slot *pool_probe(struct pool_shard *shard, const char *str, size_t len, uint32_t hash)
 {
-	FILE *file = fopen(".lal", "r+b");
+	size_t mask = shard->n_slots - 1;
+	size_t i = hash & mask;
 
-	if(!file)
+	while(shard->slots[i].data && !(shard->slots[i].hash == hash && shard->slots[i].len == len && memcmp(shard->slots[i].data, str, len) == 0))
 	{
-		file = fopen(".lal", "w+b");
+		i = (i + 1) & mask;
 	}
 
-	return file;
+	return &shard->slots[i];
 }
 
-alias_node *process_lal_file(FILE *file)
+int pool_grow(struct pool_shard *shard)
 {
-	alias_node *labels = malloc(sizeof(struct alias_node));
-	labels->next_node = NULL;
-	labels->components_len = 0;
-
-	off_t size = fsize(".lal");
-	char *contents = malloc(size * sizeof(char));
+	size_t n_slots = shard->n_slots ? shard->n_slots * 2 : POOL_INITIAL_SLOTS;
+	struct pool_slot *slots = lal_calloc(LAL_MEM_POOL, n_slots, sizeof(struct pool_slot));
 
-	size_t e = fread(contents, sizeof(char), size, file);
+	if(!slots)
+	{
+		return 0;
+	}
 
-	if(e != size)
+	for(size_t i = 0; i < shard->n_slots; i++)
 	{
-		if(feof(file))
-		{
-			lal_error(ERROR_UNEXPECTED_EOF);
-		}
-		else if(ferror(file))
+		if(shard->slots[i].data)
 		{
-			lal_error(ERROR_FAILED_READ);
+			size_t j = shard->slots[i].hash & (n_slots - 1);
+
+			while(slots[j].data)
+			{
+				j = (j + 1) & (n_slots - 1);
+			}
+
+			slots[j] = shard->slots[i];
 		}
 	}
 
-	int c = 0;
+	lal_free(LAL_MEM_POOL, shard->slots);
+	shard->slots = slots;
+	shard->n_slots = n_slots;
+
+	return 1;
+}
 
-	printf("%lld\n\n", size);
+const char *pool_store(struct pool_shard *shard, const char *str, size_t len)
+{
+	struct pool_block *block = shard->blocks;
 
-	if(size == 0)
+	if(!block || block->size - block->used < len)
 	{
-		return NULL;
-	}
+		// a string too big to share a block gets its own, behind the one being filled
+		size_t size = len > POOL_BLOCK_SIZE / 4 ? len : POOL_BLOCK_SIZE;
 
-	alias_node *labels_head = labels;
+		block = lal_malloc(LAL_MEM_POOL, sizeof(struct pool_block) + size);
 
-	while (c < size) 
-	{
-		if(parse_name(labels_head, contents, &c, size) == 0)
+		if(!block)
 		{
-			lal_error(ERROR_NO_NAME);
+			return NULL;
 		}
 
-		if(parse_components(labels_head, contents, &c, size) == 0)
+		block->used = 0;
+		block->size = size;
+
+		if(size == len && shard->blocks)
 		{
-			lal_error(ERROR_NO_COMMAND);
+			block->next = shard->blocks->next;
+			shard->blocks->next = block;
 		}
-
-		if(c < size && labels_head->components[labels_head->components_len - 1].type == LAL_END)
+		else 
 		{
-			labels_head->next_node = malloc(sizeof(alias_node));
-			labels_head = labels_head->next_node;
-			labels_head->components_len = 0;
-			labels_head->next_node = NULL;
+			block->next = shard->blocks;
+			shard->blocks = block;
 		}
 	}
 
-	free(contents);
+	char *copy = block->data + block->used;
 
-	return labels;
+	memcpy(copy, str, len);
+	block->used += len;
+
+	return copy;
 }
 
-bool exact_match(char *str1, int len1, char *str2, int len2)
+const char *string_pool_intern(string_pool *pool, const char *str, size_t len)
 {
-	if(len1 != len2)
+	uint32_t hash = pool_hash(str, len);
+	struct pool_shard *shard = pool_shard_of(pool, hash);
+	const char *pooled = NULL;
+
+	pthread_mutex_lock(&shard->lock);
+
+	// kept at most half full
+	if(shard->n_strings * 2 >= shard->n_slots && !pool_grow(shard))
 	{
-		return FALSE;
+		pthread_mutex_unlock(&shard->lock);
+		return NULL;
 	}
 
-	if(!safe_compare(str1, 0, len2, len1, str2))
+	struct pool_slot *slot = pool_probe(shard, str, len, hash);
+
+	if(slot->data)
 	{
-		return FALSE;
+		pooled = slot->data;
+	}
+	else if((pooled = pool_store(shard, str, len)))
+	{
+		slot->data = pooled;
+		slot->len = len;
+		slot->hash = hash;
+		shard->n_strings++;
 	}
 
-	return TRUE;
+	pthread_mutex_unlock(&shard->lock);
+
+	return pooled;
 }
 
-void char_v_append_char_v(char_v *targ, char_v *appd)
+// NULL when str was never interned; lookups come after parsing or under the caller's own writer lock, so no shard lock is taken
+const char *string_pool_find(string_pool *pool, const char *str, size_t len)
 {
-	for(int i = 0; i < appd->len; i++)
+	uint32_t hash = pool_hash(str, len);
+	struct pool_shard *shard = pool_shard_of(pool, hash);
+
+	if(shard->n_slots == 0)
 	{
-		if(char_v_append(targ, appd->data[i]) == 0)
-		{
-			lal_error(ERROR_FAILED_RESIZE);
-		}
+		return NULL;
 	}
+
+	return pool_probe(shard, str, len, hash)->data;
 }
 
-void char_v_append_str(char_v *targ, const char *appd)
+// str may point into v itself
+int char_v_intern(string_pool *pool, char_v *v, const char *str, size_t len)
 {
-	for(int i = 0; i < strlen(appd); i++)
+	const char *pooled = string_pool_intern(pool, str, len);
+
+	if(!pooled)
 	{
-		if(char_v_append(targ, appd[i]) == 0)
-		{
-			lal_error(ERROR_FAILED_RESIZE);
-		}
+		return 0;
 	}
+
+	char_v_release(v);
+	v->heap = (char *)pooled;
+	v->max = CHAR_V_BORROWED;
+	v->len = len;
+
+	return 1;
 }
 
-void reconstruct_lal(char_v *lal, alias_node *label)
+void print_char_v(char_v *v)
 {
-	for(alias_node *node = label; node != NULL; node = node->next_node)
-	{
-		char_v_append_char_v(lal, node->name);
-		if(char_v_append(lal, ':') == 0)
-		{
-			lal_error(ERROR_FAILED_RESIZE);
-		}
+	fwrite(char_v_data(v), sizeof(char), v->len, stdout);
+}
+
+void print_nodes(alias_node *nodes)
+{
+	for(alias_node *node = nodes; node != NULL; node = node->next_node)
+	{
+		print_char_v(&node->name);
 
 		for(int i = 0; i < node->components_len; i++)
 		{
-			switch (node->components[i].type) 
+			if(node->components[i].type == LAL_NEW_LINE)
+			{
+				printf("\n");
+			}
+			else if(node->components[i].type == LAL_END)
+			{
+				printf("\n<<END>>");
+			}
+			else if(node->components[i].type == LAL_PLAIN)
+			{
+				print_char_v(&node->components[i].contents);
+			}
+			else if(node->components[i].type == LAL_ARG || node->components[i].type == LAL_DIRECTIVE || node->components[i].type == LAL_GUARD)
+			{
+				printf("<<");
+				print_char_v(&node->components[i].contents);
+				printf(">>");
+			}
+		}
+
+		printf("\n");
+	}
+}
+
+bool is_restricted(char c)
+{
+	for(int i = 0; i < strlen(RESTRICTED_NAME_CHARACTERS); i++)
+	{
+		if(c == RESTRICTED_NAME_CHARACTERS[i])
+		{
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+bool valid_name(arg_v name)
+{
+	if(name.len == 0)
+	{
+		return FALSE;
+	}
+
+	for(size_t i = 0; i < name.len; i++)
+	{
+		if(is_restricted(name.data[i]) || name.data[i] == ':')
+		{
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+struct alias_components *add_component(alias_node *label, enum alias_type type)
+{
+	if(label->components_len >= label->components_max)
+	{
+		if(label->components_max > INT_MAX / 2)
+		{
+			return NULL;
+		}
+
+		int max = label->components_max > 0 ? label->components_max * 2 : 8;
+		struct alias_components *components = lal_realloc(LAL_MEM_NODE, label->components, sizeof(struct alias_components) * (size_t)max);
+
+		if(!components)
+		{
+			return NULL;
+		}
+
+		label->components = components;
+		label->components_max = max;
+	}
+
+	struct alias_components *component = &label->components[label->components_len];
+
+	component->type = type;
+	char_v_init(&component->contents);
+	label->components_len++;
+
+	return component;
+}
+
+enum error_code parse_name(alias_node *label, const char *contents, off_t *index, off_t size)
+{
+	off_t start = *index;
+
+	while(*index < size && contents[*index] != ':')
+	{
+		if(is_restricted(contents[*index]))
+		{
+			return ERROR_INVALID_CHARACTERS_IN_LABEL;
+		}
+
+		(*index)++;
+	}
+
+	if(*index >= size)
+	{
+		return ERROR_NO_NAME;
+	}
+
+	if(char_v_intern(label->pool, &label->name, contents + start, *index - start) == 0)
+	{
+		return ERROR_FAILED_RESIZE;
+	}
+
+	return ERROR_NONE;
+}
+
+enum error_code parse_inner(alias_node *label, const char *contents, off_t *index, off_t size)
+{
+	if(safe_compare(contents, *index, strlen("<<"), size, "<<"))
+	{
+		*index += strlen("<<");
+
+		struct alias_components *arg = add_component(label, LAL_ARG);
+
+		if(!arg)
+		{
+			return ERROR_FAILED_RESIZE;
+		}
+
+		int depth = 1;
+
+		while(depth > 0)
+		{
+			if(*index >= size)
+			{
+				return ERROR_NO_COMMAND;
+			}
+
+			int jump = 1;
+
+			if(safe_compare(contents, *index, strlen("<<"), size, "<<"))
+			{
+				depth++;
+				jump = strlen("<<");
+			}
+			else if(safe_compare(contents, *index, strlen(">>"), size, ">>"))
+			{
+				depth--;
+				jump = strlen(">>");
+			}
+
+			if(depth > 0 && char_v_append_n(&arg->contents, contents + *index, jump) == 0)
+			{
+				return ERROR_FAILED_RESIZE;
+			}
+
+			*index += jump;
+		}
+
+		if(arg->contents.len > 0 && char_v_data(&arg->contents)[0] == '@')
+		{
+			struct line_limits limits;
+			init_line_limits(&limits);
+
+			arg->type = LAL_DIRECTIVE;
+
+			if(apply_directive(char_v_data(&arg->contents), arg->contents.len, &limits) != ERROR_NONE)
+			{
+				return ERROR_BAD_DIRECTIVE;
+			}
+		}
+		else if(arg->contents.len > 0 && char_v_data(&arg->contents)[0] == '?')
+		{
+			struct guard guard;
+
+			arg->type = LAL_GUARD;
+
+			if(parse_guard(char_v_data(&arg->contents), arg->contents.len, &guard) != ERROR_NONE)
+			{
+				return ERROR_BAD_GUARD;
+			}
+		}
+	}
+	else 
+	{
+		if(label->components_len == 0 || label->components[label->components_len - 1].type != LAL_PLAIN)
+		{
+			if(!add_component(label, LAL_PLAIN))
+			{
+				return ERROR_FAILED_RESIZE;
+			}
+		}
+
+		// take the whole run up to the next marker at once
+		off_t run = 1;
+
+		while(*index + run < size && contents[*index + run] != '{' && contents[*index + run] != '}' && contents[*index + run] != '<')
+		{
+			run++;
+		}
+
+		char_v *plain = &label->components[label->components_len - 1].contents;
+
+		// a long run that opens its component is interned straight from the file, so aliases repeating it share one copy
+		if(plain->len == 0 && run > CHAR_V_INLINE_SIZE ? char_v_intern(label->pool, plain, contents + *index, run) == 0 : char_v_append_n(plain, contents + *index, run) == 0)
+		{
+			return ERROR_FAILED_RESIZE;
+		}
+
+		*index += run;
+	}
+
+	return ERROR_NONE;
+}
+
+enum error_code parse_line(alias_node *label, const char *contents, off_t *index, off_t size)
+{
+	if(safe_compare(contents, *index, strlen("{"), size, "{"))
+	{
+		*index += strlen("{");
+
+		if(!add_component(label, LAL_NEW_LINE))
+		{
+			return ERROR_FAILED_RESIZE;
+		}
+
+		int depth = 1;
+
+		while(depth > 0)
+		{
+			if(*index >= size)
+			{
+				return ERROR_NO_COMMAND;
+			}
+
+			// nested braces belong to the command itself
+			if(safe_compare(contents, *index, strlen("{"), size, "{"))
+			{
+				depth++;
+			}
+			else if(safe_compare(contents, *index, strlen("}"), size, "}"))
+			{
+				depth--;
+			}
+
+			if(depth > 0)
+			{
+				enum error_code e = parse_inner(label, contents, index, size);
+
+				if(e != ERROR_NONE)
+				{
+					return e;
+				}
+			}
+			else 
+			{
+				(*index)++;
+			}
+		}
+
+		if(!add_component(label, LAL_END_LINE))
+		{
+			return ERROR_FAILED_RESIZE;
+		}
+	}
+	else 
+	{
+		(*index)++;
+	}
+
+	return ERROR_NONE;
+}
+
+enum error_code parse_components(alias_node *label, const char *contents, off_t *index, off_t size)
+{
+	label->components_len = 0;
+
+	while(!safe_compare(contents, *index, strlen("<<END>>"), size, "<<END>>"))
+	{
+		if(*index >= size)
+		{
+			return ERROR_NO_COMMAND;
+		}
+
+		enum error_code e = parse_line(label, contents, index, size);
+
+		if(e != ERROR_NONE)
+		{
+			return e;
+		}
+	}
+
+	*index += strlen("<<END>>");
+
+	if(!add_component(label, LAL_END))
+	{
+		return ERROR_FAILED_RESIZE;
+	}
+
+	while(*index < size && is_restricted(contents[*index]))
+	{
+		(*index)++;
+	}
+
+	return ERROR_NONE;
+}
+
+alias_node *init_node(string_pool *pool)
+{
+	alias_node *node = lal_malloc(LAL_MEM_NODE, sizeof(alias_node));
+
+	if(node)
+	{
+		string_pool_hold(pool);
+		node->pool = pool;
+		char_v_init(&node->name);
+		node->components = NULL;
+		node->components_len = 0;
+		node->components_max = 0;
+		node->next_node = NULL;
+	}
+
+	return node;
+}
+
+// moves whatever is too long for the inline buffer and was built up in pieces into the pool
+enum error_code intern_components(alias_node *node)
+{
+	for(int i = 0; i < node->components_len; i++)
+	{
+		char_v *contents = &node->components[i].contents;
+
+		if(contents->len > CHAR_V_INLINE_SIZE && contents->max != CHAR_V_BORROWED && char_v_intern(node->pool, contents, char_v_data(contents), contents->len) == 0)
+		{
+			return ERROR_FAILED_RESIZE;
+		}
+	}
+
+	return ERROR_NONE;
+}
+
+// parses the records in [begin, end) into a list of its own, *last is its final node and *error_at where an error stopped it
+enum error_code parse_records(string_pool *pool, const char *contents, off_t begin, off_t end, alias_node **labels, alias_node **last, off_t *error_at)
+{
+	off_t c = begin;
+	enum error_code error = ERROR_NONE;
+	alias_node **tail = labels;
+
+	*labels = NULL;
+	*last = NULL;
+
+	while (c < end && error == ERROR_NONE)
+	{
+		alias_node *node = init_node(pool);
+
+		if(!node)
+		{
+			error = ERROR_FAILED_RESIZE;
+			break;
+		}
+
+		*tail = node;
+		tail = &node->next_node;
+		*last = node;
+
+		error = parse_name(node, contents, &c, end);
+
+		if(error == ERROR_NONE)
+		{
+			error = parse_components(node, contents, &c, end);
+		}
+
+		if(error == ERROR_NONE)
+		{
+			error = intern_components(node);
+		}
+
+		if(error == ERROR_NONE)
+		{
+			LAL_TRACE3(alias_parsed, char_v_data(&node->name), node->name.len, node->components_len);
+		}
+	}
+
+	if(error != ERROR_NONE)
+	{
+		free_nodes(*labels);
+		*labels = NULL;
+		*last = NULL;
+		*error_at = c;
+	}
+
+	return error;
+}
+
+// the end of the record starting at c, following the same nesting as parse_line and parse_inner without building anything
+off_t skip_record(const char *contents, off_t c, off_t size)
+{
+	while(c < size && contents[c] != ':')
+	{
+		c++;
+	}
+
+	while(c < size)
+	{
+		if(safe_compare(contents, c, strlen("<<END>>"), size, "<<END>>"))
+		{
+			c += strlen("<<END>>");
+
+			while(c < size && is_restricted(contents[c]))
+			{
+				c++;
+			}
+
+			return c;
+		}
+
+		if(contents[c] != '{')
+		{
+			c++;
+			continue;
+		}
+
+		int depth = 1;
+
+		for(c++; c < size && depth > 0;)
+		{
+			if(safe_compare(contents, c, strlen("<<"), size, "<<"))
+			{
+				int arg_depth = 1;
+
+				for(c += strlen("<<"); c < size && arg_depth > 0;)
+				{
+					if(safe_compare(contents, c, strlen("<<"), size, "<<"))
+					{
+						arg_depth++;
+						c += strlen("<<");
+					}
+					else if(safe_compare(contents, c, strlen(">>"), size, ">>"))
+					{
+						arg_depth--;
+						c += strlen(">>");
+					}
+					else 
+					{
+						c++;
+					}
+				}
+			}
+			else 
+			{
+				depth += contents[c] == '{' ? 1 : contents[c] == '}' ? -1 : 0;
+				c++;
+			}
+		}
+	}
+
+	return size;
+}
+
+struct parse_chunk
+{
+	string_pool *pool;
+	const char *contents;
+	off_t begin;
+	off_t end;
+	alias_node *labels;
+	alias_node *last;
+	enum error_code error;
+	off_t error_at;
+	pthread_t thread;
+};
+
+void *parse_chunk_worker(void *arg)
+{
+	struct parse_chunk *chunk = arg;
+
+	chunk->error = parse_records(chunk->pool, chunk->contents, chunk->begin, chunk->end, &chunk->labels, &chunk->last, &chunk->error_at);
+
+	return NULL;
+}
+
+// records are independent, so big files are cut at record ends and parsed on several threads, then stitched back in order
+enum error_code parse_parallel(string_pool *pool, const char *contents, off_t begin, off_t size, alias_node **labels, off_t *error_at)
+{
+	long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	off_t fit = (size - begin) / PARALLEL_PARSE_MIN_CHUNK;
+	int n_chunks = fit < PARALLEL_PARSE_MAX_THREADS ? (int)fit : PARALLEL_PARSE_MAX_THREADS;
+
+	if(n_chunks > n_cpus)
+	{
+		n_chunks = n_cpus;
+	}
+
+	alias_node *last = NULL;
+
+	if(n_chunks < 2)
+	{
+		return parse_records(pool, contents, begin, size, labels, &last, error_at);
+	}
+
+	struct parse_chunk chunks[PARALLEL_PARSE_MAX_THREADS];
+	off_t c = begin;
+
+	for(int k = 0; k < n_chunks; k++)
+	{
+		off_t target = begin + (size - begin) * (k + 1) / n_chunks;
+
+		chunks[k].pool = pool;
+		chunks[k].contents = contents;
+		chunks[k].begin = c;
+
+		while(c < target)
+		{
+			c = skip_record(contents, c, size);
+		}
+
+		chunks[k].end = k == n_chunks - 1 ? size : c;
+	}
+
+	int started = 0;
+
+	for(; started < n_chunks; started++)
+	{
+		if(pthread_create(&chunks[started].thread, NULL, parse_chunk_worker, &chunks[started]) != 0)
+		{
+			break;
+		}
+	}
+
+	// whatever could not get a thread is parsed here
+	for(int k = started; k < n_chunks; k++)
+	{
+		parse_chunk_worker(&chunks[k]);
+	}
+
+	for(int k = 0; k < started; k++)
+	{
+		pthread_join(chunks[k].thread, NULL);
+	}
+
+	enum error_code error = ERROR_NONE;
+	alias_node **tail = labels;
+
+	*labels = NULL;
+
+	for(int k = 0; k < n_chunks; k++)
+	{
+		// the first error in file order wins, as it would sequentially
+		if(error == ERROR_NONE && chunks[k].error != ERROR_NONE)
+		{
+			error = chunks[k].error;
+			*error_at = chunks[k].error_at;
+		}
+
+		if(error != ERROR_NONE)
+		{
+			free_nodes(chunks[k].labels);
+			continue;
+		}
+
+		if(chunks[k].labels)
+		{
+			*tail = chunks[k].labels;
+			tail = &chunks[k].last->next_node;
+		}
+	}
+
+	if(error != ERROR_NONE)
+	{
+		free_nodes(*labels);
+		*labels = NULL;
+	}
+
+	return error;
+}
+
+int sorted_header_len(const char *contents, off_t size)
+{
+	return safe_compare(contents, 0, strlen(SORTED_HEADER), size, SORTED_HEADER) ? strlen(SORTED_HEADER) : 0;
+}
+
+bool fd_sorted(int fd)
+{
+	char header[sizeof(SORTED_HEADER) - 1];
+
+	if(pread(fd, header, sizeof(header), 0) != sizeof(header))
+	{
+		return FALSE;
+	}
+
+	return sorted_header_len(header, sizeof(header)) > 0;
+}
+
+// the canonical order of a sorted .lal, bytewise with a prefix first
+int compare_names(const char *name1, size_t len1, const char *name2, size_t len2)
+{
+	int c = memcmp(name1, name2, len1 < len2 ? len1 : len2);
+
+	if(c != 0)
+	{
+		return c;
+	}
+
+	return len1 < len2 ? -1 : len1 > len2;
+}
+
+// stable, so of two aliases with one name the one find_node returns stays first
+alias_node *merge_sorted(alias_node *a, alias_node *b)
+{
+	alias_node *head = NULL;
+	alias_node **tail = &head;
+
+	while(a && b)
+	{
+		if(compare_names(char_v_data(&b->name), b->name.len, char_v_data(&a->name), a->name.len) < 0)
+		{
+			*tail = b;
+			b = b->next_node;
+		}
+		else 
+		{
+			*tail = a;
+			a = a->next_node;
+		}
+
+		tail = &(*tail)->next_node;
+	}
+
+	*tail = a ? a : b;
+
+	return head;
+}
+
+void sort_nodes(alias_node **labels)
+{
+	if(*labels == NULL || (*labels)->next_node == NULL)
+	{
+		return;
+	}
+
+	alias_node *slow = *labels;
+	alias_node *fast = (*labels)->next_node;
+
+	while(fast && fast->next_node)
+	{
+		slow = slow->next_node;
+		fast = fast->next_node->next_node;
+	}
+
+	alias_node *second = slow->next_node;
+	slow->next_node = NULL;
+
+	sort_nodes(labels);
+	sort_nodes(&second);
+
+	*labels = merge_sorted(*labels, second);
+}
+
+// a record start is the file start or follows "<<END>>\n", and holds a valid name followed by a line or <<END>>
+bool record_start(const char *contents, off_t c, off_t size, off_t first)
+{
+	// parse_components skips any run of restricted characters after <<END>>, so the marker may end anywhere in the run before c
+	for(off_t p = c; p != first; p--)
+	{
+		if(p - first >= (off_t)strlen("<<END>>") && safe_compare(contents, p - strlen("<<END>>"), strlen("<<END>>"), size, "<<END>>"))
+		{
+			break;
+		}
+
+		if(p - 1 == first || !is_restricted(contents[p - 1]))
+		{
+			return FALSE;
+		}
+	}
+
+	off_t colon = c;
+
+	while(colon < size && contents[colon] != ':')
+	{
+		if(is_restricted(contents[colon]))
+		{
+			return FALSE;
+		}
+
+		colon++;
+	}
+
+	return colon > c && (safe_compare(contents, colon + 1, strlen("{"), size, "{") || safe_compare(contents, colon + 1, strlen("<<END>>"), size, "<<END>>"));
+}
+
+// the first record start in [c, end), or end
+off_t next_record_start(const char *contents, off_t c, off_t end, off_t size, off_t first)
+{
+	if(c <= first)
+	{
+		return first < end ? first : end;
+	}
+
+	// c may be in the blank run after a marker any distance back, or a record may start right at c
+	off_t start = c;
+
+	while(start < end && is_restricted(contents[start]))
+	{
+		start++;
+	}
+
+	if(start < end && record_start(contents, start, size, first))
+	{
+		return start;
+	}
+
+	// otherwise the marker lies at c at the earliest, or straddles it
+	off_t scan = c - (off_t)strlen("<<END>>") < first ? first : c - (off_t)strlen("<<END>>");
+
+	while(scan < end)
+	{
+		const char *marker = memchr(contents + scan, '<', end - scan);
+
+		if(!marker)
+		{
+			return end;
+		}
+
+		off_t m = marker - contents;
+
+		if(!safe_compare(contents, m, strlen("<<END>>"), size, "<<END>>"))
+		{
+			scan = m + 1;
+			continue;
+		}
+
+		for(start = m + (off_t)strlen("<<END>>"); start < end && is_restricted(contents[start]); start++)
+		{
+		}
+
+		if(start >= end)
+		{
+			return end;
+		}
+
+		if(start >= c && record_start(contents, start, size, first))
+		{
+			return start;
+		}
+
+		scan = m + 1;
+	}
+
+	return end;
+}
+
+// binary search over byte offsets, each probe moving forward to the next record start
+bool find_sorted_record(const char *contents, off_t size, arg_v name, off_t *begin, off_t *end)
+{
+	off_t first = sorted_header_len(contents, size);
+	off_t lo = first;
+	off_t hi = size;
+	bool found = FALSE;
+
+	while(lo < hi)
+	{
+		off_t mid = lo + (hi - lo) / 2;
+		off_t r = next_record_start(contents, mid, hi, size, first);
+
+		if(r == hi)
+		{
+			hi = mid;
+			continue;
+		}
+
+		off_t colon = r;
+
+		while(contents[colon] != ':')
+		{
+			colon++;
+		}
+
+		int c = compare_names(contents + r, (size_t)(colon - r), name.data, name.len);
+
+		// a duplicate name keeps looking left, the first definition is the one a full parse runs
+		if(c == 0)
+		{
+			*begin = r;
+			*end = next_record_start(contents, r + 1, size, size, first);
+			found = TRUE;
+		}
+
+		if(c < 0)
+		{
+			lo = r + 1;
+		}
+		else 
+		{
+			hi = r;
+		}
+	}
+
+	return found;
+}
+
+bool file_sorted(FILE *file)
+{
+	return fd_sorted(fileno(file));
+}
+
+// where the last parse on this thread failed, offset -1 when it did not
+static _Thread_local off_t error_offset = -1;
+static _Thread_local off_t error_line;
+
+void note_error_position(const char *contents, off_t offset)
+{
+	error_offset = offset;
+	error_line = 1;
+
+	for(const char *c = contents; (c = memchr(c, '\n', (size_t)(contents + offset - c))); c++)
+	{
+		error_line++;
+	}
+}
+
+bool lal_error_position(off_t *offset, off_t *line)
+{
+	*offset = error_offset;
+	*line = error_line;
+
+	return error_offset >= 0;
+}
+
+// parses only the alias called name when the .lal is sorted, and the whole file otherwise
+enum error_code process_lal_alias_fd(int fd, arg_v name, alias_node **labels)
+{
+	*labels = NULL;
+	error_offset = -1;
+
+	if(!fd_sorted(fd))
+	{
+		return process_lal_fd(fd, labels);
+	}
+
+	struct stat s;
+
+	if(fstat(fd, &s) != 0)
+	{
+		return ERROR_FAILED_READ;
+	}
+
+	LAL_TRACE2(file_load, (int64_t)s.st_size, 1);
+
+	const char *contents = mmap(NULL, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	if(contents == MAP_FAILED)
+	{
+		return ERROR_FAILED_READ;
+	}
+
+	off_t begin = 0;
+	off_t end = 0;
+	enum error_code error = ERROR_NONE;
+	alias_node *last = NULL;
+	bool hit = find_sorted_record(contents, s.st_size, name, &begin, &end);
+
+	LAL_TRACE3(sorted_search, name.data, name.len, hit);
+
+	// a miss is also what a damaged or hand-edited sorted .lal looks like, so the full parse decides: it finds the alias or says where the file is wrong
+	if(!hit)
+	{
+		munmap((void *)contents, s.st_size);
+
+		return process_lal_fd(fd, labels);
+	}
+
+	off_t error_at = 0;
+	string_pool *pool = string_pool_create();
+
+	error = pool ? parse_records(pool, contents, begin, end, labels, &last, &error_at) : ERROR_FAILED_RESIZE;
+
+	if(error != ERROR_NONE && pool)
+	{
+		note_error_position(contents, error_at);
+	}
+
+	// the nodes hold their own references
+	string_pool_release(pool);
+
+	munmap((void *)contents, s.st_size);
+
+	return error;
+}
+
+enum error_code process_lal_alias(FILE *file, arg_v name, alias_node **labels)
+{
+	return process_lal_alias_fd(fileno(file), name, labels);
+}
+
+// pread, so the offset of a FILE sharing fd is left alone
+enum error_code read_whole(int fd, char *contents, off_t size)
+{
+	for(off_t done = 0; done < size;)
+	{
+		ssize_t n = pread(fd, contents + done, size - done, done);
+
+		if(n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+
+		if(n <= 0)
+		{
+			return n == 0 ? ERROR_UNEXPECTED_EOF : ERROR_FAILED_READ;
+		}
+
+		done += n;
+	}
+
+	return ERROR_NONE;
+}
+
+enum error_code process_lal_fd(int fd, alias_node **labels)
+{
+	*labels = NULL;
+	error_offset = -1;
+
+	struct stat s;
+
+	if(fstat(fd, &s) != 0)
+	{
+		return ERROR_FAILED_READ;
+	}
+
+	off_t size = s.st_size;
+
+	LAL_TRACE2(file_load, (int64_t)size, 0);
+
+	if(size == 0)
+	{
+		return ERROR_NONE;
+	}
+
+	if((uint64_t)size > SIZE_MAX)
+	{
+		return ERROR_FAILED_RESIZE;
+	}
+
+	char *contents = lal_malloc(LAL_MEM_FILE, (size_t)size * sizeof(char));
+
+	if(!contents)
+	{
+		return ERROR_FAILED_RESIZE;
+	}
+
+	enum error_code error = read_whole(fd, contents, size);
+
+	if(error != ERROR_NONE)
+	{
+		lal_free(LAL_MEM_FILE, contents);
+
+		return error;
+	}
+
+	alias_node *last = NULL;
+	off_t begin = sorted_header_len(contents, size);
+	off_t error_at = 0;
+	string_pool *pool = string_pool_create();
+
+	if(!pool)
+	{
+		error = ERROR_FAILED_RESIZE;
+	}
+	else if(size >= PARALLEL_PARSE_MIN_SIZE)
+	{
+		error = parse_parallel(pool, contents, begin, size, labels, &error_at);
+	}
+	else 
+	{
+		error = parse_records(pool, contents, begin, size, labels, &last, &error_at);
+	}
+
+	if(error != ERROR_NONE && pool)
+	{
+		note_error_position(contents, error_at);
+	}
+
+	string_pool_release(pool);
+	lal_free(LAL_MEM_FILE, contents);
+
+	return error;
+}
+
+enum error_code process_lal_file(FILE *file, alias_node **labels)
+{
+	return process_lal_fd(fileno(file), labels);
+}
+
+bool exact_match(const char *str1, size_t len1, const char *str2, size_t len2)
+{
+	if(len1 != len2)
+	{
+		return FALSE;
+	}
+
+	if(!safe_compare(str1, 0, len2, (off_t)len1, str2))
+	{
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+int char_v_append_char_v(char_v *targ, char_v *appd)
+{
+	return char_v_append_n(targ, char_v_data(appd), appd->len);
+}
+
+int char_v_append_arg_v(char_v *targ, arg_v appd)
+{
+	return char_v_append_n(targ, appd.data, appd.len);
+}
+
+int char_v_append_str(char_v *targ, const char *appd)
+{
+	return char_v_append_n(targ, appd, strlen(appd));
+}
+
+enum error_code reconstruct_lal(char_v *lal, alias_node *label)
+{
+	for(alias_node *node = label; node != NULL; node = node->next_node)
+	{
+		int ok = char_v_append_char_v(lal, &node->name) && char_v_append(lal, ':');
+
+		for(int i = 0; ok && i < node->components_len; i++)
+		{
+			switch (node->components[i].type)
 			{
 				case LAL_PLAIN:
-					char_v_append_char_v(lal, node->components[i].contents);
+					ok = char_v_append_char_v(lal, &node->components[i].contents);
 					break;
 				case LAL_ARG:
-					char_v_append_str(lal, "<<");
-					char_v_append_char_v(lal, node->components[i].contents);
-					char_v_append_str(lal, ">>");
+				case LAL_DIRECTIVE:
+				case LAL_GUARD:
+					ok = char_v_append_str(lal, "<<") && char_v_append_char_v(lal, &node->components[i].contents) && char_v_append_str(lal, ">>");
 					break;
 				case LAL_NEW_LINE:
-					if(char_v_append(lal, '{') == 0)
-					{
-						lal_error(ERROR_FAILED_RESIZE);
-					}
+					ok = char_v_append(lal, '{');
 					break;
 				case LAL_END_LINE:
-					if(char_v_append(lal, '}') == 0)
-					{
-						lal_error(ERROR_FAILED_RESIZE);
-					}
+					ok = char_v_append(lal, '}');
 					break;
 				case LAL_END:
-					char_v_append_str(lal, "<<END>>\n");
+					ok = char_v_append_str(lal, "<<END>>\n");
 					break;
 			}
 		}
+
+		if(!ok)
+		{
+			return ERROR_FAILED_RESIZE;
+		}
 	}
+
+	return ERROR_NONE;
 }
 
 void reset_component(struct alias_components *component)
 {
-	switch (component->type) 
+	char_v_release(&component->contents);
+	component->type = 0;
+}
+
+void delete_components(struct alias_components *components, int n_components)
+{
+	for(int i = 0; i < n_components; i++)
 	{
-		case LAL_PLAIN:
-			free_char_v(component->contents);
-			break;
-		case LAL_ARG:
-			free_char_v(component->contents);
-			break;
-		case LAL_NEW_LINE:
-			break;
-		case LAL_END_LINE:
-			break;
-		case LAL_END:
+		reset_component(&components[i]);
+	}
+}
+
+void free_node(alias_node *node)
+{
+	char_v_release(&node->name);
+	delete_components(node->components, node->components_len);
+	lal_free(LAL_MEM_NODE, node->components);
+	string_pool_release(node->pool);
+	lal_free(LAL_MEM_NODE, node);
+}
+
+void free_nodes(alias_node *labels)
+{
+	while(labels != NULL)
+	{
+		alias_node *next = labels->next_node;
+
+		free_node(labels);
+		labels = next;
+	}
+}
+
+void delete_node(alias_node *node, alias_node *prev, alias_node **head)
+{
+	if(prev == NULL)
+	{
+		*head = node->next_node;
+	}
+	else 
+	{
+		prev->next_node = node->next_node;
+	}
+
+	free_node(node);
+}
+
+alias_node *find_node(alias_node *labels, arg_v name)
+{
+	// names are interned in the list's pool, so one the pool never saw matches nothing and the rest is an address compare
+	const char *pooled = labels ? string_pool_find(labels->pool, name.data, name.len) : NULL;
+
+	for(alias_node *node = labels; pooled != NULL && node != NULL; node = node->next_node)
+	{
+		if(char_v_data(&node->name) == pooled)
+		{
+			LAL_TRACE3(lookup, name.data, name.len, 1);
+
+			return node;
+		}
+	}
+
+	LAL_TRACE3(lookup, name.data, name.len, 0);
+
+	return NULL;
+}
+
+alias_node *find_node_prev(alias_node *labels, arg_v name, alias_node **prev)
+{
+	const char *pooled = labels ? string_pool_find(labels->pool, name.data, name.len) : NULL;
+
+	*prev = NULL;
+
+	for(alias_node *node = labels; node != NULL; node = node->next_node)
+	{
+		if(char_v_data(&node->name) == pooled)
+		{
+			return node;
+		}
+
+		*prev = node;
+	}
+
+	return NULL;
+}
+
+// puts an alias back the way append_lines found it: gone if append_lines created it, otherwise kept components and an <<END>>
+void undo_append(alias_node **labels, alias_node *node, alias_node *prev, bool created, int kept)
+{
+	if(created)
+	{
+		delete_node(node, prev, labels);
+		return;
+	}
+
+	while(node->components_len > kept)
+	{
+		reset_component(&node->components[node->components_len - 1]);
+		node->components_len--;
+	}
+
+	// the slot the old <<END>> was in is still allocated, so this cannot fail
+	add_component(node, LAL_END);
+}
+
+enum error_code append_lines(alias_node **labels, arg_v name, arg_v *lines, int n_lines)
+{
+	LAL_TRACE3(edit, "append", name.data, name.len);
+
+	if(n_lines < 1)
+	{
+		return ERROR_INSUFFICIENT_INPUTS;
+	}
+
+	if(!valid_name(name))
+	{
+		return ERROR_INVALID_CHARACTERS_IN_LABEL;
+	}
+
+	alias_node *last_node = NULL;
+	alias_node *current_node = find_node_prev(*labels, name, &last_node);
+	bool created = current_node == NULL;
+
+	if(created)
+	{
+		while(last_node && last_node->next_node)
+		{
+			last_node = last_node->next_node;
+		}
+
+		// a new alias shares the pool of the list it joins, the first of a list starts one
+		string_pool *pool = *labels ? (*labels)->pool : string_pool_create();
+
+		current_node = pool ? init_node(pool) : NULL;
+
+		if(!*labels)
+		{
+			string_pool_release(pool);
+		}
+
+		if(!current_node)
+		{
+			return ERROR_FAILED_RESIZE;
+		}
+
+		if(char_v_intern(current_node->pool, &current_node->name, name.data, name.len) == 0)
+		{
+			free_node(current_node);
+			return ERROR_FAILED_RESIZE;
+		}
+
+		if(last_node)
+		{
+			last_node->next_node = current_node;
+		}
+		else 
+		{
+			*labels = current_node;
+		}
+	}
+	else 
+	{
+		// to replace <<END>> with a LAL_NEW_LINE
+		reset_component(&current_node->components[current_node->components_len - 1]);
+		current_node->components_len--;
+	}
+
+	// a line that fails to parse leaves the alias as it was, not half appended
+	int kept = current_node->components_len;
+	enum error_code e = ERROR_NONE;
+
+	for(int l = 0; l < n_lines && e == ERROR_NONE; l++)
+	{
+		if(!add_component(current_node, LAL_NEW_LINE))
+		{
+			e = ERROR_FAILED_RESIZE;
 			break;
+		}
+
+		off_t i = 0;
+
+		while(i < (off_t)lines[l].len && e == ERROR_NONE)
+		{
+			e = parse_inner(current_node, lines[l].data, &i, (off_t)lines[l].len);
+		}
+
+		if(e == ERROR_NONE && !add_component(current_node, LAL_END_LINE))
+		{
+			e = ERROR_FAILED_RESIZE;
+		}
+	}
+
+	if(e == ERROR_NONE && !add_component(current_node, LAL_END))
+	{
+		e = ERROR_FAILED_RESIZE;
+	}
+
+	if(e != ERROR_NONE)
+	{
+		undo_append(labels, current_node, last_node, created, kept);
+	}
+
+	return e;
+}
+
+enum error_code truncate_lines(alias_node **labels, arg_v name, int n_truncate)
+{
+	LAL_TRACE3(edit, "truncate", name.data, name.len);
+
+	alias_node *prev_node = NULL;
+	alias_node *current_node = find_node_prev(*labels, name, &prev_node);
+
+	if(current_node == NULL)
+	{
+		return ERROR_LABEL_NOT_FOUND;
+	}
+
+	if(n_truncate < 0)
+	{
+		return ERROR_BAD_NUMERICAL_INPUT;
+	}
+
+	for(int n = 0; n < n_truncate; n++)
+	{
+		while(current_node->components_len > 1 && current_node->components[current_node->components_len - 1].type != LAL_NEW_LINE)
+		{
+			reset_component(&current_node->components[current_node->components_len - 1]);
+			current_node->components_len--;
+		}
+
+		current_node->components[current_node->components_len - 1].type = LAL_END;
+	}
+
+	if(current_node->components_len == 1)
+	{
+		delete_node(current_node, prev_node, labels);
+	}
+
+	return ERROR_NONE;
+}
+
+enum error_code delete_alias(alias_node **labels, arg_v name)
+{
+	LAL_TRACE3(edit, "delete", name.data, name.len);
+
+	alias_node *prev_node = NULL;
+	alias_node *current_node = find_node_prev(*labels, name, &prev_node);
+
+	if(current_node == NULL)
+	{
+		return ERROR_LABEL_NOT_FOUND;
+	}
+
+	delete_node(current_node, prev_node, labels);
+
+	return ERROR_NONE;
+}
+
+enum error_code rename_alias(alias_node *labels, arg_v name, arg_v new_name)
+{
+	LAL_TRACE3(edit, "rename", name.data, name.len);
+
+	alias_node *current_node = find_node(labels, name);
+
+	if(current_node == NULL)
+	{
+		return ERROR_LABEL_NOT_FOUND;
+	}
+
+	if(!valid_name(new_name))
+	{
+		return ERROR_INVALID_CHARACTERS_IN_LABEL;
+	}
+
+	alias_node *existing = find_node(labels, new_name);
+
+	if(existing != NULL && existing != current_node)
+	{
+		return ERROR_LABEL_EXISTS;
+	}
+
+	if(char_v_intern(current_node->pool, &current_node->name, new_name.data, new_name.len) == 0)
+	{
+		return ERROR_FAILED_RESIZE;
 	}
 
-	component->contents = NULL;
-	component->type = 0;
+	return ERROR_NONE;
 }
 
-void delete_components(struct alias_components *components, int n_components)
+bool needs_quoting(arg_v a)
 {
-	for(int i = 0; i < n_components; i++)
+	if(a.len == 0)
 	{
-		reset_component(&components[i]);
+		return TRUE;
 	}
-}
 
-void delete_node(alias_node *node, alias_node *prev, alias_node **head)
-{
-	if(prev== NULL && node->next_node == NULL)
+	for(size_t i = 0; i < a.len; i++)
 	{
-		alias_node *tmp = node;
-		*head = NULL;
-		free_char_v(tmp->name);
-		delete_components(tmp->components, tmp->components_len);
-		free(tmp);
+		char c = a.data[i];
+
+		if(!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || strchr("_@%+=:,./-", c)))
+		{
+			return TRUE;
+		}
 	}
-	else if(node->next_node == NULL)
+
+	return FALSE;
+}
+
+int char_v_append_quoted(char_v *targ, arg_v appd)
+{
+	if(!needs_quoting(appd))
 	{
-		alias_node *tmp = node;
-		node = NULL;
-		prev->next_node = NULL;
-		free_char_v(tmp->name);
-		delete_components(tmp->components, tmp->components_len);
-		free(tmp);
+		return char_v_append_arg_v(targ, appd);
 	}
-	else if(prev== NULL)
+
+	if(char_v_append(targ, '\'') == 0)
 	{
-		alias_node *tmp = node;
-		*head = node->next_node;
-		node = NULL;
-		free_char_v(tmp->name);
-		delete_components(tmp->components, tmp->components_len);
-		free(tmp);
+		return 0;
 	}
-	else 
+
+	for(size_t i = 0; i < appd.len; i++)
 	{
-		prev->next_node = node->next_node;
-		free_char_v(node->name);
-		delete_components(node->components, node->components_len);
-		free(node);
+		int ok = appd.data[i] == '\'' ? char_v_append_str(targ, "'\\''") : char_v_append(targ, appd.data[i]);
+
+		if(!ok)
+		{
+			return 0;
+		}
 	}
-}
 
-#define FLAGS_APPEND_NAME_OFFSET 1
-#define FLAGS_APPEND_INPUT_OFFSET 2
-#define FLAGS_APPEND_MIN_SUBCMDS 3
+	return char_v_append(targ, '\'');
+}
 
-#define FLAGS_TRUNCATE_NAME_OFFSET 1
-#define FLAGS_TRUNCATE_NUMBER_OFFSET 2
-#define FLAGS_TRUNCATE_MIN_SUBCMDS 2
-#define FLAGS_TRUNCATE_DEFAULT_SUBCMDS 2
+void init_line_limits(struct line_limits *limits)
+{
+	limits->timeout_us = 0;
+	limits->grace_us = 2000000;
+	limits->cpu_s = -1;
+	limits->mem_bytes = -1;
+	limits->nofile = -1;
+}
 
-#define FLAGS_DELETE_NAME_OFFSET 1
-#define FLAGS_DELETE_MIN_SUBCMDS 2
+// "30", "1.5s", "250ms", "2m" or "1h" in microseconds, -1 if malformed
+int64_t duration_from_str(const char *str, size_t len)
+{
+	int64_t whole = 0;
+	int64_t fraction = 0;
+	int64_t scale = 1;
+	size_t i = 0;
 
-#define FLAGS_RENAME_NAME_OFFSET 1
-#define FLAGS_RENAME_INPUT_OFFSET 2
-#define FLAGS_RENAME_MIN_SUBCMDS 3
+	for(; i < len && str[i] >= '0' && str[i] <= '9'; i++)
+	{
+		whole = whole * 10 + (str[i] - '0');
+	}
 
-void append_to_lal(commands *cmd, alias_node **labels)
-{
-	if(cmd->n_cmds < FLAGS_APPEND_MIN_SUBCMDS)
+	if(i == 0 || whole > 1000000000)
 	{
-		lal_error(ERROR_INSUFFICIENT_INPUTS);
+		return -1;
 	}
 
-	bool is_new = TRUE;
-	alias_node *current_node = NULL;
-	alias_node *last_node = NULL;
+	if(i < len && str[i] == '.')
+	{
+		for(i++; i < len && str[i] >= '0' && str[i] <= '9'; i++)
+		{
+			if(scale < 1000000)
+			{
+				fraction = fraction * 10 + (str[i] - '0');
+				scale *= 10;
+			}
+		}
+	}
 
-	char_v *name = cmd->sub_cmds[FLAGS_APPEND_NAME_OFFSET].contents;
+	int64_t unit = 1000000;
 
-	for(alias_node *node = *labels; node != NULL; node = node->next_node)
+	if(exact_match(str + i, len - i, "ms", 2))
+	{
+		unit = 1000;
+	}
+	else if(exact_match(str + i, len - i, "m", 1))
+	{
+		unit = 60 * 1000000LL;
+	}
+	else if(exact_match(str + i, len - i, "h", 1))
+	{
+		unit = 3600 * 1000000LL;
+	}
+	else if(i != len && !exact_match(str + i, len - i, "s", 1))
 	{
-		last_node = node;
+		return -1;
+	}
 
-		if(compare_char_v(name, node->name))
-		{
-			is_new = FALSE;
+	return whole * unit + fraction * unit / scale;
+}
 
-			current_node = node;
+// "4096", "64K", "512M" or "2G" in bytes, -1 if malformed
+int64_t size_from_str(const char *str, size_t len)
+{
+	int64_t unit = 1;
 
-			break;
-		}
-	}
+	const char *suffixes = "KMG";
 
-	if(is_new)
+	for(int s = 0; len > 0 && s < strlen(suffixes); s++)
 	{
-		if(last_node)
-		{
-			last_node->next_node = malloc(sizeof(alias_node));
-			current_node = last_node->next_node;
-		}
-		else 
+		if(str[len - 1] == suffixes[s] || str[len - 1] == suffixes[s] - 'A' + 'a')
 		{
-			*labels = malloc(sizeof(alias_node));
-			current_node = *labels;
+			unit = 1LL << (10 * (s + 1));
+			len--;
+			break;
 		}
-
-		current_node->name = copy_char_v(name); 
-		current_node->components_len = 0;
-	}
-	else 
-	{
-		// to replace <<END>> with a LAL_NEW_LINE
-		reset_component(&current_node->components[current_node->components_len - 1]);
-		current_node->components_len--;
 	}
 
-	for(int sc = FLAGS_APPEND_INPUT_OFFSET; sc < cmd->n_cmds; sc++)
+	if(len == 0 || len > 12)
 	{
-		current_node->components_len++;
-		current_node->components[current_node->components_len - 1].type = LAL_NEW_LINE;
+		return -1;
+	}
 
-		int i = 0;
+	int64_t n = 0;
 
-		while(i < cmd->sub_cmds[sc].contents->len)
+	for(size_t i = 0; i < len; i++)
+	{
+		if(str[i] < '0' || str[i] > '9')
 		{
-			parse_inner(current_node, cmd->sub_cmds[sc].contents->data, &i, cmd->sub_cmds[sc].contents->len);
+			return -1;
 		}
 
-		current_node->components_len++;
-		current_node->components[current_node->components_len - 1].type = LAL_END_LINE;
+		n = n * 10 + (str[i] - '0');
 	}
 
-	current_node->components_len++;
-	current_node->components[current_node->components_len - 1].type = LAL_END;
+	return n * unit;
 }
 
-void truncate_from_lal(commands *cmd, alias_node **labels)
+// text is the whole directive, '@' included
+enum error_code apply_directive(const char *text, size_t len, struct line_limits *limits)
 {
-	if(cmd->n_cmds < FLAGS_TRUNCATE_MIN_SUBCMDS)
+	size_t key_end = 1;
+
+	while(key_end < len && text[key_end] != ' ')
 	{
-		lal_error(ERROR_INSUFFICIENT_INPUTS);
+		key_end++;
 	}
 
-	alias_node *current_node = NULL;
-	alias_node *prev_node = NULL;
-
-	char_v *name = cmd->sub_cmds[FLAGS_TRUNCATE_NAME_OFFSET].contents;
+	size_t value = key_end;
 
-	for(alias_node *node = *labels; node != NULL; node = node->next_node)
+	while(value < len && text[value] == ' ')
 	{
-		if(compare_char_v(node->name, name))
-		{
-			current_node = node;
+		value++;
+	}
 
-			break;
-		}
-		else 
-		{
-			prev_node = node;
-		}
+	while(len > value && text[len - 1] == ' ')
+	{
+		len--;
 	}
 
-	if(current_node == NULL)
+	const char *key = text + 1;
+	size_t key_len = key_end - 1;
+	int64_t n = -1;
+
+	if(exact_match(key, key_len, "timeout", strlen("timeout")))
+	{
+		n = duration_from_str(text + value, len - value);
+		limits->timeout_us = n;
+	}
+	else if(exact_match(key, key_len, "grace", strlen("grace")))
+	{
+		n = duration_from_str(text + value, len - value);
+		limits->grace_us = n;
+	}
+	else if(exact_match(key, key_len, "cpu", strlen("cpu")))
+	{
+		n = duration_from_str(text + value, len - value);
+		limits->cpu_s = n < 0 ? n : (n + 999999) / 1000000;
+	}
+	else if(exact_match(key, key_len, "mem", strlen("mem")))
+	{
+		n = size_from_str(text + value, len - value);
+		limits->mem_bytes = n;
+	}
+	else if(exact_match(key, key_len, "nofile", strlen("nofile")))
 	{
-		lal_error(ERROR_LABEL_NOT_FOUND);
+		n = size_from_str(text + value, len - value);
+		limits->nofile = n;
 	}
 
-	int n_truncate = 1;
+	return n < 0 ? ERROR_BAD_DIRECTIVE : ERROR_NONE;
+}
 
-	if(cmd->n_cmds > FLAGS_TRUNCATE_DEFAULT_SUBCMDS)
+// applies every directive of the line whose first component is at i
+enum error_code line_directives(alias_node *node, int i, struct line_limits *limits)
+{
+	for(; i < node->components_len && node->components[i].type != LAL_END_LINE; i++)
 	{
-		struct sub_cmd number_input = cmd->sub_cmds[FLAGS_TRUNCATE_NUMBER_OFFSET];
-		n_truncate = nn_int_from_str(number_input.contents->data, number_input.contents->len);
+		char_v *contents = &node->components[i].contents;
 
-		if(n_truncate < 0)
+		if(node->components[i].type == LAL_DIRECTIVE && apply_directive(char_v_data(contents), contents->len, limits) != ERROR_NONE)
 		{
-			lal_error(ERROR_BAD_NUMERICAL_INPUT);
+			return ERROR_BAD_DIRECTIVE;
 		}
 	}
 
-	for(int n = 0; n < n_truncate; n++)
+	return ERROR_NONE;
+}
+
+// a line of nothing but directives sets them for the lines after it
+bool blank_text(const char *text, size_t len)
+{
+	for(size_t c = 0; c < len; c++)
 	{
-		while(current_node->components_len > 1 && current_node->components[current_node->components_len - 1].type != LAL_NEW_LINE)
+		if(!strchr(" \t\n", text[c]))
 		{
-			reset_component(&current_node->components[current_node->components_len - 1]);
-			current_node->components_len--;
+			return FALSE;
 		}
-
-		current_node->components[current_node->components_len - 1].type = LAL_END;
-		current_node->components[current_node->components_len - 1].contents = NULL;
 	}
 
-	if(current_node->components_len == 1)
-	{
-		delete_node(current_node, prev_node, labels);
-	}
+	return TRUE;
 }
 
-void delete_from_lal(commands *cmd, alias_node **labels)
+bool directives_only(alias_node *node, int i)
 {
-	if(cmd->n_cmds < FLAGS_DELETE_MIN_SUBCMDS)
+	bool found = FALSE;
+
+	for(; i < node->components_len && node->components[i].type != LAL_END_LINE; i++)
 	{
-		lal_error(ERROR_INSUFFICIENT_INPUTS);
-	}
+		struct alias_components *component = &node->components[i];
 
-	alias_node *current_node = NULL;
-	alias_node *prev_node = NULL;
+		if(component->type == LAL_DIRECTIVE)
+		{
+			found = TRUE;
+		}
+		else if(component->type == LAL_ARG)
+		{
+			return FALSE;
+		}
+		else if(component->type == LAL_PLAIN && !blank_text(char_v_data(&component->contents), component->contents.len))
+		{
+			return FALSE;
+		}
+	}
 
-	char_v *name = cmd->sub_cmds[FLAGS_DELETE_NAME_OFFSET].contents;
+	return found;
+}
 
-	for(alias_node *node = *labels; node != NULL; node = node->next_node)
+// every <<N>> in an operand must be a number
+bool operand_valid(arg_v operand)
+{
+	for(size_t c = 0; c < operand.len; c++)
 	{
-		if(compare_char_v(node->name, name))
+		if(!safe_compare(operand.data, c, strlen("<<"), operand.len, "<<"))
 		{
-			current_node = node;
+			continue;
+		}
 
-			break;
+		size_t start = c + strlen("<<");
+		size_t end = start;
+
+		while(end < operand.len && operand.data[end] >= '0' && operand.data[end] <= '9')
+		{
+			end++;
 		}
-		else 
+
+		if(end == start || !safe_compare(operand.data, end, strlen(">>"), operand.len, ">>"))
 		{
-			prev_node = node;
+			return FALSE;
 		}
+
+		c = end + strlen(">>") - 1;
 	}
 
-	if(current_node == NULL)
+	return TRUE;
+}
+
+bool env_name_valid(arg_v name)
+{
+	if(name.len == 0 || (name.data[0] >= '0' && name.data[0] <= '9'))
+	{
+		return FALSE;
+	}
+
+	for(size_t c = 0; c < name.len; c++)
 	{
-		lal_error(ERROR_LABEL_NOT_FOUND);
+		char n = name.data[c];
+
+		if(!((n >= 'a' && n <= 'z') || (n >= 'A' && n <= 'Z') || (n >= '0' && n <= '9') || n == '_'))
+		{
+			return FALSE;
+		}
 	}
 
-	delete_node(current_node, prev_node, labels);
+	return TRUE;
 }
 
-void rename_in_lal(commands *cmd, alias_node *labels)
+// text is the whole guard, '?' included
+enum error_code parse_guard(const char *text, size_t len, struct guard *guard)
 {
-	if(cmd->n_cmds < FLAGS_RENAME_MIN_SUBCMDS)
+	size_t c = 1;
+
+	guard->negate = c < len && text[c] == '!';
+	c += guard->negate;
+
+	size_t key = c;
+
+	while(c < len && text[c] != ' ')
 	{
-		lal_error(ERROR_INSUFFICIENT_INPUTS);
+		c++;
 	}
 
-	alias_node *current_node = NULL;
+	arg_v keyword = { text + key, c - key };
 
-	char_v *name = cmd->sub_cmds[FLAGS_RENAME_NAME_OFFSET].contents;
+	guard->n_operands = 0;
 
-	for(alias_node *node = labels; node != NULL; node = node->next_node)
+	while(c < len)
 	{
-		if(compare_char_v(node->name, name))
+		while(c < len && text[c] == ' ')
 		{
-			current_node = node;
+			c++;
+		}
 
+		if(c == len)
+		{
 			break;
 		}
-	}
 
-	if(current_node == NULL)
-	{
-		lal_error(ERROR_LABEL_NOT_FOUND);
-	}
+		if(guard->n_operands == 2)
+		{
+			return ERROR_BAD_GUARD;
+		}
 
-	current_node->name = copy_char_v(cmd->sub_cmds[FLAGS_RENAME_INPUT_OFFSET].contents);
-}
+		size_t start = c;
 
-int use_flags(commands *cmd, alias_node **labels, FILE *file)
-{
-	char_v *new_lal = init_char_v();
-	char_v *flag = cmd->sub_cmds[0].contents;
+		while(c < len && text[c] != ' ')
+		{
+			c++;
+		}
+
+		arg_v operand = { text + start, c - start };
+
+		if(!operand_valid(operand))
+		{
+			return ERROR_BAD_GUARD;
+		}
+
+		guard->operands[guard->n_operands++] = operand;
+	}
+
+	int n_operands = -1;
 
-	if(exact_match(flag->data, flag->len, "-append", strlen("-append")) || exact_match(flag->data, flag->len, "a", strlen("a")))
+	if(exact_match(keyword.data, keyword.len, "exists", strlen("exists")))
 	{
-		append_to_lal(cmd, labels);
+		guard->kind = GUARD_EXISTS;
+		n_operands = 1;
 	}
-	else if(exact_match(flag->data, flag->len, "-truncate", strlen("-truncate")) || exact_match(flag->data, flag->len, "t", strlen("t")))
+	else if(exact_match(keyword.data, keyword.len, "newer", strlen("newer")))
 	{
-		truncate_from_lal(cmd, labels);
+		guard->kind = GUARD_NEWER;
+		n_operands = 2;
 	}
-	else if(exact_match(flag->data, flag->len, "-delete", strlen("-delete")) || exact_match(flag->data, flag->len, "d", strlen("d")))
+	else if(exact_match(keyword.data, keyword.len, "env", strlen("env")))
 	{
-		delete_from_lal(cmd, labels);
+		guard->kind = GUARD_ENV;
+		n_operands = 1;
 	}
-	else if(exact_match(flag->data, flag->len, "-rename", strlen("-rename")) || exact_match(flag->data, flag->len, "rn", strlen("rn")))
+	else if(exact_match(keyword.data, keyword.len, "ok", strlen("ok")))
 	{
-		rename_in_lal(cmd, *labels);
+		guard->kind = GUARD_OK;
+		n_operands = 0;
 	}
-	else 
+	else if(exact_match(keyword.data, keyword.len, "fail", strlen("fail")))
+	{
+		guard->kind = GUARD_FAIL;
+		n_operands = 0;
+	}
+	else if(exact_match(keyword.data, keyword.len, "status", strlen("status")))
+	{
+		guard->kind = GUARD_STATUS;
+		n_operands = 1;
+	}
+
+	if(n_operands != guard->n_operands)
 	{
-		lal_error(ERROR_UNKNOWN_FLAG);
+		return ERROR_BAD_GUARD;
 	}
 
-	reconstruct_lal(new_lal, *labels);
+	if(guard->kind == GUARD_ENV)
+	{
+		arg_v name = guard->operands[0];
+		const char *equals = memchr(name.data, '=', name.len);
+
+		name.len = equals ? (size_t)(equals - name.data) : name.len;
 
-	FILE *overwrite = freopen(NULL, "w+b", file);
+		if(!env_name_valid(name))
+		{
+			return ERROR_BAD_GUARD;
+		}
+	}
 
-	if(overwrite == NULL)
+	if(guard->kind == GUARD_STATUS && nn_int_from_str(guard->operands[0].data, guard->operands[0].len) < 0)
 	{
-		return 0;
+		return ERROR_BAD_GUARD;
 	}
 
-	int write_check = fwrite(new_lal->data, sizeof(new_lal->data[0]), new_lal->len, overwrite);
+	return ERROR_NONE;
+}
 
-	if(feof(overwrite) || write_check != new_lal->len)
+enum error_code substitute_args(char_v *out, arg_v text, arg_v *args, int n_args)
+{
+	for(size_t c = 0; c < text.len; c++)
 	{
-		return 0;
-	}
+		if(safe_compare(text.data, c, strlen("<<"), text.len, "<<"))
+		{
+			size_t start = c + strlen("<<");
+			size_t end = start;
 
-	free_char_v(new_lal);
+			while(end < text.len && text.data[end] != '>')
+			{
+				end++;
+			}
 
-	return 1;
-}
+			int arg_n = nn_int_from_str(text.data + start, end - start);
+
+			if(arg_n < 0 || arg_n >= n_args)
+			{
+				return ERROR_INSUFFICIENT_INPUTS;
+			}
 
-#define INPUT_NAME_OFFSET 0
-#define INPUT_ARGS_OFFSET 1
-#define INPUT_MIN_SUBCMDS 1
+			if(char_v_append_arg_v(out, args[arg_n]) == 0)
+			{
+				return ERROR_FAILED_RESIZE;
+			}
+
+			c = end + strlen(">>") - 1;
+		}
+		else if(char_v_append(out, text.data[c]) == 0)
+		{
+			return ERROR_FAILED_RESIZE;
+		}
+	}
+
+	return char_v_append(out, '\0') ? ERROR_NONE : ERROR_FAILED_RESIZE;
+}
 
-void use_input(commands *cmd, alias_node *labels)
+// "VAR" is set, or "VAR=VAL" is set to exactly VAL
+bool env_matches(char *operand)
 {
-	if(cmd->n_cmds < INPUT_MIN_SUBCMDS)
+	char *equals = strchr(operand, '=');
+
+	if(equals)
 	{
-		lal_error(ERROR_INSUFFICIENT_INPUTS);
+		*equals = '\0';
 	}
 
-	alias_node *current_node = NULL;
+	char *value = getenv(operand);
 
-	char_v *name = cmd->sub_cmds[INPUT_NAME_OFFSET].contents;
+	return value != NULL && (!equals || strcmp(value, equals + 1) == 0);
+}
 
-	for(alias_node *node = labels; node != NULL; node = node->next_node)
+// last_status is the exit code of the last line that ran, 0 before any has
+enum error_code eval_guard(struct guard *guard, arg_v *args, int n_args, int last_status, bool *pass)
+{
+	char_v operands[2];
+	enum error_code e = ERROR_NONE;
+
+	for(int o = 0; o < guard->n_operands; o++)
 	{
-		if(compare_char_v(node->name, name))
-		{
-			current_node = node;
+		char_v_init(&operands[o]);
 
-			break;
+		if(e == ERROR_NONE)
+		{
+			e = substitute_args(&operands[o], guard->operands[o], args, n_args);
 		}
 	}
 
-	if(current_node == NULL)
+	if(e == ERROR_NONE)
 	{
-		lal_error(ERROR_LABEL_NOT_FOUND);
-	}
+		struct stat a;
+		struct stat b;
+
+		switch (guard->kind)
+		{
+			case GUARD_EXISTS:
+				*pass = stat(char_v_data(&operands[0]), &a) == 0;
+				break;
+			case GUARD_NEWER:
+				// as test -nt, a missing second file is older than anything
+				*pass = stat(char_v_data(&operands[0]), &a) == 0 && (stat(char_v_data(&operands[1]), &b) != 0
+					|| a.st_mtim.tv_sec > b.st_mtim.tv_sec || (a.st_mtim.tv_sec == b.st_mtim.tv_sec && a.st_mtim.tv_nsec > b.st_mtim.tv_nsec));
+				break;
+			case GUARD_ENV:
+				*pass = env_matches(char_v_data(&operands[0]));
+				break;
+			case GUARD_OK:
+				*pass = last_status == 0;
+				break;
+			case GUARD_FAIL:
+				*pass = last_status != 0;
+				break;
+			case GUARD_STATUS:
+				*pass = last_status == nn_int_from_str(char_v_data(&operands[0]), strlen(char_v_data(&operands[0])));
+				break;
+		}
 
-	char_v **args = malloc(sizeof(char_v *) * cmd->n_cmds - INPUT_ARGS_OFFSET);
+		*pass = guard->negate ? !*pass : *pass;
+	}
 
-	for(int a = 0; a < cmd->n_cmds - INPUT_ARGS_OFFSET; a++)
+	for(int o = 0; o < guard->n_operands; o++)
 	{
-		args[a] = init_char_v();
-		char_v_append_char_v(args[a], cmd->sub_cmds[a + INPUT_ARGS_OFFSET].contents);
+		char_v_release(&operands[o]);
 	}
 
-	char_v *sys_cmd = init_char_v();
+	return e;
+}
+
+// the line whose first component is at i runs only if all of its guards pass
+enum error_code line_guards(alias_node *node, int i, arg_v *args, int n_args, int last_status, bool *pass)
+{
+	*pass = TRUE;
 
-	for(int i = 0; i < current_node->components_len; i++)
+	for(; *pass && i < node->components_len && node->components[i].type != LAL_END_LINE; i++)
 	{
-		if(current_node->components[i].type == LAL_PLAIN)
+		char_v *contents = &node->components[i].contents;
+		struct guard guard;
+
+		if(node->components[i].type != LAL_GUARD)
 		{
-			char_v_append_char_v(sys_cmd, current_node->components[i].contents);
+			continue;
 		}
-		else if(current_node->components[i].type == LAL_ARG)
-		{
-			int arg_n = nn_int_from_str(current_node->components[i].contents->data, current_node->components[i].contents->len);
-
-			if(arg_n >= cmd->n_cmds - INPUT_ARGS_OFFSET)
-			{
-				lal_error(ERROR_INSUFFICIENT_INPUTS);
-			}
 
-			char_v_append_char_v(sys_cmd, args[arg_n]);
-		}
-		else if(current_node->components[i].type == LAL_END_LINE)
+		if(parse_guard(char_v_data(contents), contents->len, &guard) != ERROR_NONE)
 		{
-			char_v_append(sys_cmd, '\0');
+			return ERROR_BAD_GUARD;
+		}
 
-			system(sys_cmd->data);
-			free_char_v(sys_cmd);
+		enum error_code e = eval_guard(&guard, args, n_args, last_status, pass);
 
-			sys_cmd = init_char_v();
-		}
-		else if(current_node->components[i].type == LAL_END)
+		if(e != ERROR_NONE)
 		{
-			free_char_v(sys_cmd);
+			return e;
 		}
 	}
 
-	for(int a = 0; a < cmd->n_cmds - INPUT_ARGS_OFFSET; a++)
-	{
-		free_char_v(args[a]);
-	}
-
-	free(args);
-}
-
-int use_default(alias_node *labels)
-{
+	return ERROR_NONE;
 }
 
-int run_command(commands *cmd, alias_node **labels, FILE *file)
+// appends the line whose first component is at *i, leaving *i on its LAL_END_LINE
+enum error_code expand_line(char_v *out, alias_node *node, int *i, arg_v *args, int n_args, bool quote)
 {
-	if(cmd->sub_cmds[0].type == FLAG)
+	for(; *i < node->components_len && node->components[*i].type != LAL_END_LINE; (*i)++)
 	{
-		if(use_flags(cmd, labels, file) == 0)
+		struct alias_components *component = &node->components[*i];
+
+		if(component->type == LAL_PLAIN)
+		{
+			if(char_v_append_char_v(out, &component->contents) == 0)
+			{
+				return ERROR_FAILED_RESIZE;
+			}
+		}
+		else if(component->type == LAL_ARG)
 		{
-			lal_error(ERROR_LAL_REWRITE_FAILURE);
+			int arg_n = nn_int_from_str(char_v_data(&component->contents), component->contents.len);
+
+			if(arg_n < 0 || arg_n >= n_args)
+			{
+				return ERROR_INSUFFICIENT_INPUTS;
+			}
+
+			int ok = quote ? char_v_append_quoted(out, args[arg_n]) : char_v_append_arg_v(out, args[arg_n]);
+
+			if(!ok)
+			{
+				return ERROR_FAILED_RESIZE;
+			}
 		}
 	}
-	else if(cmd->sub_cmds[0].type == INPUT)
-	{
-		use_input(cmd, *labels);
-	}
-	else if(cmd->sub_cmds[0].type == EMPTY)
-	{
-	}
 
-	return 1;
+	return ERROR_NONE;
 }
-
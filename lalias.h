@@ -1,14 +1,27 @@
 #include <stdio.h>
 #include <stddef.h>
-#define MAX_SUB_CMDS 128
-#define MAX_ALIAS_COMPONENTS 256
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "liblalias.h"
+
+#define CHAR_V_INLINE_SIZE 24
+#define CHAR_V_BORROWED 0
 #define RESTRICTED_NAME_CHARACTERS " \n{}<>"
+#define SORTED_HEADER "<<SORTED>>\n"
+
+typedef int bool;
+
+#define TRUE (bool)1
+#define FALSE (bool)0
 
 typedef struct char_v char_v;
+typedef struct arg_v arg_v;
 typedef struct alias_node alias_node;
 typedef struct commands commands;
+typedef struct string_pool string_pool;
 
-enum sub_cmd_type 
+enum sub_cmd_type
 {
 	INPUT,
 	FLAG, // append, rename, replace, delete, add
@@ -22,44 +35,154 @@ enum alias_type
 	LAL_NEW_LINE,
 	LAL_END_LINE,
 	LAL_END,
+	LAL_DIRECTIVE,
+	LAL_GUARD,
+};
+
+// non-owning view into argv
+struct arg_v
+{
+	const char *data;
+	size_t len;
 };
 
 struct sub_cmd
 {
 	enum sub_cmd_type type;
-	char_v *contents;
+	arg_v contents;
 };
 
 struct commands
 {
-	struct sub_cmd sub_cmds[MAX_SUB_CMDS];
+	struct sub_cmd *sub_cmds;
 	int n_cmds;
 };
 
+// strings up to CHAR_V_INLINE_SIZE bytes live in the struct itself, use char_v_data to reach them
+// max is CHAR_V_BORROWED for a read-only view into the string pool, appending to one copies it out first
 struct char_v
 {
-	char *data;
-	int max;
-	int len;
+	union
+	{
+		char *heap;
+		char small[CHAR_V_INLINE_SIZE];
+	};
+	size_t max;
+	size_t len;
 };
 
 struct alias_components
 {
 	enum alias_type type;
-	char_v *contents;
+	char_v contents;
 };
 
 struct alias_node
 {
-	struct alias_components components[MAX_ALIAS_COMPONENTS];
-	char_v *name;
+	struct alias_components *components;
+	char_v name;
 	int components_len;
+	int components_max;
+	string_pool *pool; // shared by the whole list
 	alias_node *next_node;
 };
 
+// set by <<@timeout 30>>, <<@grace 5>>, <<@cpu 10>>, <<@mem 512M>> and <<@nofile 64>>
+struct line_limits
+{
+	int64_t timeout_us; // 0 for none
+	int64_t grace_us;
+	int64_t cpu_s; // -1 for unset
+	int64_t mem_bytes;
+	int64_t nofile;
+};
+
+enum guard_kind
+{
+	GUARD_EXISTS,
+	GUARD_NEWER,
+	GUARD_ENV,
+	GUARD_OK,
+	GUARD_FAIL,
+	GUARD_STATUS
+};
+
+// <<?exists P>>, <<?newer A B>>, <<?env VAR>>, <<?env VAR=VAL>>, <<?ok>>, <<?fail>> or <<?status N>>, each may be negated as <<?!...>>
+struct guard
+{
+	enum guard_kind kind;
+	bool negate;
+	arg_v operands[2]; // views into the component, may hold <<N>>
+	int n_operands;
+};
+
+static inline char *char_v_data(char_v *v)
+{
+	// a borrowed max of 0 wraps round to the heap side
+	return v->max - 1 >= CHAR_V_INLINE_SIZE ? v->heap : v->small;
+}
+
+// lalias.c
+int nn_int_from_str(const char *str, size_t len);
+bool exact_match(const char *str1, size_t len1, const char *str2, size_t len2);
+
+void char_v_init(char_v *v);
+void char_v_release(char_v *v);
+char_v *init_char_v();
+void free_char_v(char_v *v);
+int char_v_append(char_v *vec, char c);
+int char_v_append_n(char_v *vec, const char *src, size_t n);
+int char_v_append_char_v(char_v *targ, char_v *appd);
+int char_v_append_arg_v(char_v *targ, arg_v appd);
+int char_v_append_str(char_v *targ, const char *appd);
+int char_v_append_quoted(char_v *targ, arg_v appd);
+
+// hash-consed and never moved, so equal interned strings share one address; every alias name is interned
+// a pool starts with one reference, each node of a list holds another and the last release frees it
+string_pool *string_pool_create();
+void string_pool_hold(string_pool *pool);
+void string_pool_release(string_pool *pool);
+const char *string_pool_intern(string_pool *pool, const char *str, size_t len);
+const char *string_pool_find(string_pool *pool, const char *str, size_t len);
+int char_v_intern(string_pool *pool, char_v *v, const char *str, size_t len);
+
+alias_node *find_node(alias_node *labels, arg_v name);
+void free_nodes(alias_node *labels);
+void print_nodes(alias_node *nodes);
+
+enum error_code process_lal_file(FILE *file, alias_node **labels);
+enum error_code process_lal_alias(FILE *file, arg_v name, alias_node **labels);
+bool file_sorted(FILE *file);
+// the same on a plain descriptor, for callers that never set up a FILE
+enum error_code process_lal_fd(int fd, alias_node **labels);
+enum error_code process_lal_alias_fd(int fd, arg_v name, alias_node **labels);
+bool fd_sorted(int fd);
+// the byte offset and 1-based line a failed process_lal_* on this thread stopped at, FALSE when the failure was not in the text
+bool lal_error_position(off_t *offset, off_t *line);
+void sort_nodes(alias_node **labels);
+enum error_code reconstruct_lal(char_v *lal, alias_node *label);
+void init_line_limits(struct line_limits *limits);
+enum error_code apply_directive(const char *text, size_t len, struct line_limits *limits);
+enum error_code line_directives(alias_node *node, int i, struct line_limits *limits);
+bool directives_only(alias_node *node, int i);
+bool blank_text(const char *text, size_t len);
+bool env_name_valid(arg_v name);
+enum error_code parse_guard(const char *text, size_t len, struct guard *guard);
+enum error_code substitute_args(char_v *out, arg_v text, arg_v *args, int n_args);
+enum error_code line_guards(alias_node *node, int i, arg_v *args, int n_args, int last_status, bool *pass);
+enum error_code expand_line(char_v *out, alias_node *node, int *i, arg_v *args, int n_args, bool quote);
+
+enum error_code append_lines(alias_node **labels, arg_v name, arg_v *lines, int n_lines);
+enum error_code truncate_lines(alias_node **labels, arg_v name, int n_truncate);
+enum error_code delete_alias(alias_node **labels, arg_v name);
+enum error_code rename_alias(alias_node *labels, arg_v name, arg_v new_name);
+
+// cli.c
+void lal_error(enum error_code code);
+bool use_report_flag(int *argc, char ***argv);
 commands *parse_inputs(int argc, char *argv[]);
-alias_node *process_lal_file(FILE *file);
+void free_commands(commands *cmd);
+void print_commands(commands *cmd);
+int use_index_flags(commands *cmd);
 int run_command(commands *cmd, struct alias_node **labels, FILE *file);
 FILE *open_lal();
-void print_nodes(alias_node *nodes);
-
@@ -0,0 +1,725 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lalias.h"
+#include "lal_alloc.h"
+#include "lal_trace.h"
+
+struct snapshot_component
+{
+	enum alias_type type;
+	const char *data;
+	size_t len;
+	int arg;
+};
+
+struct snapshot_alias
+{
+	const char *name;
+	size_t name_len;
+	uint32_t hash;
+	int first_component;
+	int n_components;
+	int n_lines;
+};
+
+// built once from the alias list and never written to again
+struct lal_snapshot
+{
+	atomic_int refs;
+	int n_aliases;
+	struct snapshot_alias *aliases;
+	struct snapshot_component *components;
+	char *strings;
+	int *buckets;
+	uint32_t bucket_mask;
+};
+
+struct lal_handle
+{
+	// writers serialise on writer_lock and are the only ones touching labels
+	pthread_mutex_t writer_lock;
+	alias_node *labels;
+
+	_Atomic(lal_snapshot *) current;
+	// readers inside lal_acquire, counted under the epoch they started in; publish flips the epoch and then waits
+	// only for the side it flipped away from, so it waits for at most the readers already mid-acquire, never for
+	// ones that arrive later, and a steady stream of lal_acquire cannot hold a writer up
+	atomic_uint epoch;
+	atomic_int acquiring[2];
+};
+
+static arg_v view_of(const char *str)
+{
+	arg_v view = { str, strlen(str) };
+
+	return view;
+}
+
+static uint32_t hash_name(const char *name, size_t len)
+{
+	uint32_t h = 2166136261u;
+
+	for(size_t i = 0; i < len; i++)
+	{
+		h ^= (unsigned char)name[i];
+		h *= 16777619u;
+	}
+
+	return h;
+}
+
+static void free_snapshot(lal_snapshot *snapshot)
+{
+	lal_free(LAL_MEM_LIBRARY, snapshot->aliases);
+	lal_free(LAL_MEM_LIBRARY, snapshot->components);
+	lal_free(LAL_MEM_LIBRARY, snapshot->strings);
+	lal_free(LAL_MEM_LIBRARY, snapshot->buckets);
+	lal_free(LAL_MEM_LIBRARY, snapshot);
+}
+
+static lal_snapshot *build_snapshot(alias_node *labels)
+{
+	int n_aliases = 0;
+	int n_components = 0;
+	size_t n_bytes = 0;
+
+	for(alias_node *node = labels; node != NULL; node = node->next_node)
+	{
+		n_aliases++;
+		n_bytes += node->name.len;
+
+		for(int i = 0; i < node->components_len; i++)
+		{
+			n_components++;
+			n_bytes += node->components[i].contents.len;
+		}
+	}
+
+	uint32_t n_buckets = 1;
+
+	while(n_buckets < 2 * (uint32_t)n_aliases)
+	{
+		n_buckets <<= 1;
+	}
+
+	lal_snapshot *snapshot = lal_calloc(LAL_MEM_LIBRARY, 1, sizeof(lal_snapshot));
+
+	if(!snapshot)
+	{
+		return NULL;
+	}
+
+	snapshot->aliases = lal_malloc(LAL_MEM_LIBRARY, sizeof(struct snapshot_alias) * (n_aliases > 0 ? n_aliases : 1));
+	snapshot->components = lal_malloc(LAL_MEM_LIBRARY, sizeof(struct snapshot_component) * (n_components > 0 ? n_components : 1));
+	snapshot->strings = lal_malloc(LAL_MEM_LIBRARY, n_bytes > 0 ? n_bytes : 1);
+	snapshot->buckets = lal_malloc(LAL_MEM_LIBRARY, sizeof(int) * n_buckets);
+
+	if(!snapshot->aliases || !snapshot->components || !snapshot->strings || !snapshot->buckets)
+	{
+		free_snapshot(snapshot);
+		return NULL;
+	}
+
+	atomic_init(&snapshot->refs, 1);
+	snapshot->n_aliases = n_aliases;
+	snapshot->bucket_mask = n_buckets - 1;
+
+	for(uint32_t b = 0; b < n_buckets; b++)
+	{
+		snapshot->buckets[b] = -1;
+	}
+
+	char *strings = snapshot->strings;
+	int a = 0;
+	int c = 0;
+
+	for(alias_node *node = labels; node != NULL; node = node->next_node, a++)
+	{
+		struct snapshot_alias *alias = &snapshot->aliases[a];
+
+		memcpy(strings, char_v_data(&node->name), node->name.len);
+		alias->name = strings;
+		alias->name_len = node->name.len;
+		alias->hash = hash_name(alias->name, alias->name_len);
+		alias->first_component = c;
+		alias->n_components = node->components_len;
+		alias->n_lines = 0;
+		strings += node->name.len;
+
+		for(int i = 0; i < node->components_len; i++, c++)
+		{
+			struct snapshot_component *component = &snapshot->components[c];
+			char_v *contents = &node->components[i].contents;
+
+			memcpy(strings, char_v_data(contents), contents->len);
+			component->type = node->components[i].type;
+			component->data = strings;
+			component->len = contents->len;
+			component->arg = -1;
+			strings += contents->len;
+
+			if(component->type == LAL_ARG)
+			{
+				component->arg = nn_int_from_str(component->data, component->len);
+			}
+			else if(component->type == LAL_END_LINE)
+			{
+				alias->n_lines++;
+			}
+		}
+
+		// the first definition of a name wins, as in find_node
+		uint32_t b = alias->hash & snapshot->bucket_mask;
+
+		while(snapshot->buckets[b] != -1 && !exact_match(snapshot->aliases[snapshot->buckets[b]].name, snapshot->aliases[snapshot->buckets[b]].name_len, alias->name, alias->name_len))
+		{
+			b = (b + 1) & snapshot->bucket_mask;
+		}
+
+		if(snapshot->buckets[b] == -1)
+		{
+			snapshot->buckets[b] = a;
+		}
+	}
+
+	return snapshot;
+}
+
+static const struct snapshot_alias *snapshot_find(const lal_snapshot *snapshot, const char *name, size_t name_len)
+{
+	uint32_t b = hash_name(name, name_len) & snapshot->bucket_mask;
+
+	while(snapshot->buckets[b] != -1)
+	{
+		const struct snapshot_alias *alias = &snapshot->aliases[snapshot->buckets[b]];
+
+		if(exact_match(alias->name, alias->name_len, name, name_len))
+		{
+			LAL_TRACE3(lookup, name, name_len, 1);
+
+			return alias;
+		}
+
+		b = (b + 1) & snapshot->bucket_mask;
+	}
+
+	LAL_TRACE3(lookup, name, name_len, 0);
+
+	return NULL;
+}
+
+lal_snapshot *lal_acquire(lal_handle *handle)
+{
+	// while our side of acquiring is non-zero no writer may drop the snapshot we are about to reference
+	atomic_int *acquiring = &handle->acquiring[atomic_load(&handle->epoch) & 1];
+
+	atomic_fetch_add(acquiring, 1);
+
+	lal_snapshot *snapshot = atomic_load(&handle->current);
+	atomic_fetch_add(&snapshot->refs, 1);
+
+	atomic_fetch_sub(acquiring, 1);
+
+	return snapshot;
+}
+
+void lal_release(lal_snapshot *snapshot)
+{
+	if(atomic_fetch_sub(&snapshot->refs, 1) == 1)
+	{
+		free_snapshot(snapshot);
+	}
+}
+
+// called with writer_lock held
+static enum error_code publish(lal_handle *handle)
+{
+	lal_snapshot *fresh = build_snapshot(handle->labels);
+
+	if(!fresh)
+	{
+		return ERROR_FAILED_RESIZE;
+	}
+
+	lal_snapshot *old = atomic_exchange(&handle->current, fresh);
+
+	// readers counted on the other side from here on load current after the exchange, so only this side may hold old
+	unsigned int before = atomic_fetch_add(&handle->epoch, 1);
+
+	while(atomic_load(&handle->acquiring[before & 1]) != 0)
+	{
+		sched_yield();
+	}
+
+	lal_release(old);
+
+	return ERROR_NONE;
+}
+
+enum error_code lal_create(lal_handle **handle)
+{
+	*handle = lal_malloc(LAL_MEM_LIBRARY, sizeof(lal_handle));
+
+	if(!*handle)
+	{
+		return ERROR_FAILED_RESIZE;
+	}
+
+	lal_snapshot *empty = build_snapshot(NULL);
+
+	if(!empty)
+	{
+		lal_free(LAL_MEM_LIBRARY, *handle);
+		*handle = NULL;
+		return ERROR_FAILED_RESIZE;
+	}
+
+	pthread_mutex_init(&(*handle)->writer_lock, NULL);
+	(*handle)->labels = NULL;
+	atomic_init(&(*handle)->current, empty);
+	atomic_init(&(*handle)->epoch, 0);
+	atomic_init(&(*handle)->acquiring[0], 0);
+	atomic_init(&(*handle)->acquiring[1], 0);
+
+	return ERROR_NONE;
+}
+
+static enum error_code read_labels(const char *path, alias_node **labels)
+{
+	FILE *file = fopen(path, "rb");
+
+	if(!file)
+	{
+		return ERROR_NO_LAL;
+	}
+
+	enum error_code e = process_lal_file(file, labels);
+
+	fclose(file);
+
+	return e;
+}
+
+enum error_code lal_load(lal_handle **handle, const char *path)
+{
+	*handle = NULL;
+
+	alias_node *labels = NULL;
+	enum error_code e = read_labels(path, &labels);
+
+	if(e != ERROR_NONE)
+	{
+		return e;
+	}
+
+	lal_handle *loaded = NULL;
+	e = lal_create(&loaded);
+
+	if(e == ERROR_NONE)
+	{
+		loaded->labels = labels;
+		e = publish(loaded);
+	}
+	else 
+	{
+		free_nodes(labels);
+	}
+
+	if(e != ERROR_NONE)
+	{
+		lal_destroy(loaded);
+		return e;
+	}
+
+	*handle = loaded;
+
+	return ERROR_NONE;
+}
+
+enum error_code lal_reload(lal_handle *handle, const char *path)
+{
+	alias_node *labels = NULL;
+	enum error_code e = read_labels(path, &labels);
+
+	if(e != ERROR_NONE)
+	{
+		return e;
+	}
+
+	pthread_mutex_lock(&handle->writer_lock);
+
+	alias_node *old = handle->labels;
+	handle->labels = labels;
+	e = publish(handle);
+
+	if(e != ERROR_NONE)
+	{
+		handle->labels = old;
+		old = labels;
+	}
+
+	pthread_mutex_unlock(&handle->writer_lock);
+
+	free_nodes(old);
+
+	return e;
+}
+
+void lal_destroy(lal_handle *handle)
+{
+	if(handle)
+	{
+		lal_release(atomic_load(&handle->current));
+		pthread_mutex_destroy(&handle->writer_lock);
+		free_nodes(handle->labels);
+		lal_free(LAL_MEM_LIBRARY, handle);
+	}
+}
+
+static char *to_string(char_v *v)
+{
+	char *str = lal_malloc(LAL_MEM_LIBRARY, v->len + 1);
+
+	if(str)
+	{
+		memcpy(str, char_v_data(v), v->len);
+		str[v->len] = '\0';
+	}
+
+	return str;
+}
+
+enum error_code lal_snapshot_lookup(const lal_snapshot *snapshot, const char *name, char **definition)
+{
+	const struct snapshot_alias *alias = snapshot_find(snapshot, name, strlen(name));
+
+	if(!alias)
+	{
+		return ERROR_LABEL_NOT_FOUND;
+	}
+
+	if(!definition)
+	{
+		return ERROR_NONE;
+	}
+
+	char_v *text = init_char_v();
+
+	if(!text)
+	{
+		return ERROR_FAILED_RESIZE;
+	}
+
+	arg_v alias_name = { alias->name, alias->name_len };
+	int ok = char_v_append_arg_v(text, alias_name) && char_v_append(text, ':');
+
+	for(int i = 0; ok && i < alias->n_components; i++)
+	{
+		const struct snapshot_component *component = &snapshot->components[alias->first_component + i];
+		arg_v contents = { component->data, component->len };
+
+		switch (component->type)
+		{
+			case LAL_PLAIN:
+				ok = char_v_append_arg_v(text, contents);
+				break;
+			case LAL_ARG:
+			case LAL_DIRECTIVE:
+			case LAL_GUARD:
+				ok = char_v_append_str(text, "<<") && char_v_append_arg_v(text, contents) && char_v_append_str(text, ">>");
+				break;
+			case LAL_NEW_LINE:
+				ok = char_v_append(text, '{');
+				break;
+			case LAL_END_LINE:
+				ok = char_v_append(text, '}');
+				break;
+			case LAL_END:
+				ok = char_v_append_str(text, "<<END>>\n");
+				break;
+		}
+	}
+
+	*definition = ok ? to_string(text) : NULL;
+	free_char_v(text);
+
+	return *definition ? ERROR_NONE : ERROR_FAILED_RESIZE;
+}
+
+// directives_only over a snapshot: such a line only sets limits, so expanding it prints nothing, as --expand does
+static bool snapshot_directives_only(const struct snapshot_component *components, int i, int n_components)
+{
+	bool found = FALSE;
+
+	for(; i < n_components && components[i].type != LAL_END_LINE; i++)
+	{
+		if(components[i].type == LAL_DIRECTIVE)
+		{
+			found = TRUE;
+		}
+		else if(components[i].type == LAL_ARG || (components[i].type == LAL_PLAIN && !blank_text(components[i].data, components[i].len)))
+		{
+			return FALSE;
+		}
+	}
+
+	return found;
+}
+
+enum error_code lal_snapshot_expand(const lal_snapshot *snapshot, const char *name, int argc, const char *const argv[], char ***lines, int *n_lines)
+{
+	*lines = NULL;
+	*n_lines = 0;
+
+	const struct snapshot_alias *alias = snapshot_find(snapshot, name, strlen(name));
+
+	if(!alias)
+	{
+		return ERROR_LABEL_NOT_FOUND;
+	}
+
+	char **expanded = lal_calloc(LAL_MEM_LIBRARY, alias->n_lines > 0 ? alias->n_lines : 1, sizeof(char *));
+	char_v *line = init_char_v();
+
+	enum error_code e = (expanded && line) ? ERROR_NONE : ERROR_FAILED_RESIZE;
+	int n = 0;
+
+	const struct snapshot_component *components = &snapshot->components[alias->first_component];
+
+	// guards are not evaluated when expanding, so like --expand their lines are always written and the guards left out
+	for(int i = 0; e == ERROR_NONE && i < alias->n_components; i++)
+	{
+		const struct snapshot_component *component = &components[i];
+		int ok = 1;
+
+		if(component->type == LAL_NEW_LINE && snapshot_directives_only(components, i + 1, alias->n_components))
+		{
+			while(components[i].type != LAL_END_LINE)
+			{
+				i++;
+			}
+		}
+		else if(component->type == LAL_PLAIN)
+		{
+			arg_v contents = { component->data, component->len };
+			ok = char_v_append_arg_v(line, contents);
+		}
+		else if(component->type == LAL_ARG)
+		{
+			if(component->arg < 0 || component->arg >= argc)
+			{
+				e = ERROR_INSUFFICIENT_INPUTS;
+				break;
+			}
+
+			ok = char_v_append_str(line, argv[component->arg]);
+		}
+		else if(component->type == LAL_END_LINE)
+		{
+			expanded[n] = to_string(line);
+			ok = expanded[n] != NULL;
+			n++;
+			line->len = 0;
+		}
+
+		if(!ok)
+		{
+			e = ERROR_FAILED_RESIZE;
+		}
+	}
+
+	if(line)
+	{
+		free_char_v(line);
+	}
+
+	if(e != ERROR_NONE)
+	{
+		lal_free_lines(expanded, n);
+		return e;
+	}
+
+	*lines = expanded;
+	*n_lines = n;
+
+	return ERROR_NONE;
+}
+
+enum error_code lal_lookup(lal_handle *handle, const char *name, char **definition)
+{
+	lal_snapshot *snapshot = lal_acquire(handle);
+	enum error_code e = lal_snapshot_lookup(snapshot, name, definition);
+
+	lal_release(snapshot);
+
+	return e;
+}
+
+enum error_code lal_expand(lal_handle *handle, const char *name, int argc, const char *const argv[], char ***lines, int *n_lines)
+{
+	lal_snapshot *snapshot = lal_acquire(handle);
+	enum error_code e = lal_snapshot_expand(snapshot, name, argc, argv, lines, n_lines);
+
+	lal_release(snapshot);
+
+	return e;
+}
+
+enum error_code lal_append(lal_handle *handle, const char *name, int n_lines, const char *const lines[])
+{
+	arg_v *views = lal_malloc(LAL_MEM_LIBRARY, sizeof(arg_v) * (n_lines > 0 ? n_lines : 1));
+
+	if(!views)
+	{
+		return ERROR_FAILED_RESIZE;
+	}
+
+	for(int l = 0; l < n_lines; l++)
+	{
+		views[l] = view_of(lines[l]);
+	}
+
+	pthread_mutex_lock(&handle->writer_lock);
+
+	enum error_code e = append_lines(&handle->labels, view_of(name), views, n_lines);
+
+	// a failed edit changed nothing, so readers keep the snapshot they have
+	if(e == ERROR_NONE)
+	{
+		e = publish(handle);
+	}
+
+	pthread_mutex_unlock(&handle->writer_lock);
+
+	lal_free(LAL_MEM_LIBRARY, views);
+
+	return e;
+}
+
+enum error_code lal_truncate(lal_handle *handle, const char *name, int n_lines)
+{
+	pthread_mutex_lock(&handle->writer_lock);
+
+	enum error_code e = truncate_lines(&handle->labels, view_of(name), n_lines);
+
+	if(e == ERROR_NONE)
+	{
+		e = publish(handle);
+	}
+
+	pthread_mutex_unlock(&handle->writer_lock);
+
+	return e;
+}
+
+enum error_code lal_delete(lal_handle *handle, const char *name)
+{
+	pthread_mutex_lock(&handle->writer_lock);
+
+	enum error_code e = delete_alias(&handle->labels, view_of(name));
+
+	if(e == ERROR_NONE)
+	{
+		e = publish(handle);
+	}
+
+	pthread_mutex_unlock(&handle->writer_lock);
+
+	return e;
+}
+
+enum error_code lal_rename(lal_handle *handle, const char *name, const char *new_name)
+{
+	pthread_mutex_lock(&handle->writer_lock);
+
+	enum error_code e = rename_alias(handle->labels, view_of(name), view_of(new_name));
+
+	if(e == ERROR_NONE)
+	{
+		e = publish(handle);
+	}
+
+	pthread_mutex_unlock(&handle->writer_lock);
+
+	return e;
+}
+
+enum error_code lal_save(lal_handle *handle, const char *path)
+{
+	char_v *text = init_char_v();
+
+	if(!text)
+	{
+		return ERROR_FAILED_RESIZE;
+	}
+
+	pthread_mutex_lock(&handle->writer_lock);
+	enum error_code e = reconstruct_lal(text, handle->labels);
+	pthread_mutex_unlock(&handle->writer_lock);
+
+	if(e != ERROR_NONE)
+	{
+		free_char_v(text);
+		return e;
+	}
+
+	size_t path_len = strlen(path);
+	char *tmp_path = lal_malloc(LAL_MEM_LIBRARY, path_len + strlen(".tmp") + 1);
+
+	if(!tmp_path)
+	{
+		free_char_v(text);
+		return ERROR_FAILED_RESIZE;
+	}
+
+	memcpy(tmp_path, path, path_len);
+	strcpy(tmp_path + path_len, ".tmp");
+
+	FILE *file = fopen(tmp_path, "wb");
+	e = ERROR_LAL_REWRITE_FAILURE;
+
+	if(file)
+	{
+		size_t written = fwrite(char_v_data(text), sizeof(char), text->len, file);
+
+		if(fclose(file) == 0 && written == text->len && rename(tmp_path, path) == 0)
+		{
+			e = ERROR_NONE;
+		}
+		else 
+		{
+			remove(tmp_path);
+		}
+	}
+
+	lal_free(LAL_MEM_LIBRARY, tmp_path);
+	free_char_v(text);
+
+	return e;
+}
+
+void lal_free_string(char *str)
+{
+	lal_free(LAL_MEM_LIBRARY, str);
+}
+
+void lal_free_lines(char **lines, int n_lines)
+{
+	if(!lines)
+	{
+		return;
+	}
+
+	for(int l = 0; l < n_lines; l++)
+	{
+		lal_free(LAL_MEM_LIBRARY, lines[l]);
+	}
+
+	lal_free(LAL_MEM_LIBRARY, lines);
+}
@@ -0,0 +1,76 @@
+#ifndef LIBLALIAS_H
+#define LIBLALIAS_H
+
+enum error_code
+{
+	ERROR_NONE,
+	ERROR_FAILED_RESIZE,
+	ERROR_UNKNOWN_FLAG,
+	ERROR_NO_INPUT,
+	ERROR_NO_LABEL,
+	ERROR_NO_LAL,
+	ERROR_FAILED_READ,
+	ERROR_UNEXPECTED_EOF,
+	ERROR_INVALID_CHARACTERS_IN_LABEL,
+	ERROR_NO_NAME,
+	ERROR_NO_COMMAND,
+	ERROR_NO_FILE,
+	ERROR_INSUFFICIENT_INPUTS,
+	ERROR_BAD_NUMERICAL_INPUT,
+	ERROR_FAILED_TO_TRUNCATE,
+	ERROR_LABEL_NOT_FOUND,
+	ERROR_LAL_REWRITE_FAILURE,
+	ERROR_FAILED_SPAWN,
+	ERROR_FAILED_STATS_READ,
+	ERROR_BAD_DIRECTIVE,
+	ERROR_FAILED_COMPILE,
+	ERROR_UNKNOWN_SHELL,
+	ERROR_BAD_GUARD,
+	ERROR_NO_INDEX,
+	ERROR_BAD_INDEX,
+	ERROR_FAILED_INDEX,
+	ERROR_LABEL_EXISTS
+};
+
+// an alias table; every call may be made from any thread
+typedef struct lal_handle lal_handle;
+
+// an immutable view of a handle's table, taken without locks and valid until released
+typedef struct lal_snapshot lal_snapshot;
+
+// every call returns ERROR_NONE on success, lal_strerror describes any other code
+const char *lal_strerror(enum error_code code);
+
+// *handle is owned by the caller and released with lal_destroy
+enum error_code lal_create(lal_handle **handle);
+enum error_code lal_load(lal_handle **handle, const char *path);
+void lal_destroy(lal_handle *handle);
+
+// *definition is the alias as it would be written to a .lal, freed with lal_free_string; may be NULL
+enum error_code lal_lookup(lal_handle *handle, const char *name, char **definition);
+
+// *lines is an array of *n_lines NUL-terminated commands, freed with lal_free_lines
+enum error_code lal_expand(lal_handle *handle, const char *name, int argc, const char *const argv[], char ***lines, int *n_lines);
+
+enum error_code lal_append(lal_handle *handle, const char *name, int n_lines, const char *const lines[]);
+enum error_code lal_truncate(lal_handle *handle, const char *name, int n_lines);
+enum error_code lal_delete(lal_handle *handle, const char *name);
+enum error_code lal_rename(lal_handle *handle, const char *name, const char *new_name);
+
+// replaces path atomically
+enum error_code lal_save(lal_handle *handle, const char *path);
+
+// rereads path; readers keep their current snapshot until they release it
+enum error_code lal_reload(lal_handle *handle, const char *path);
+
+// every acquired snapshot must be passed to lal_release exactly once
+lal_snapshot *lal_acquire(lal_handle *handle);
+void lal_release(lal_snapshot *snapshot);
+
+enum error_code lal_snapshot_lookup(const lal_snapshot *snapshot, const char *name, char **definition);
+enum error_code lal_snapshot_expand(const lal_snapshot *snapshot, const char *name, int argc, const char *const argv[], char ***lines, int *n_lines);
+
+void lal_free_string(char *str);
+void lal_free_lines(char **lines, int n_lines);
+
+#endif
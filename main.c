@@ -1,21 +1,75 @@
+#include <fcntl.h>
 #include <stdio.h>
+#include <unistd.h>
 
 #include "lalias.h"
+#include "shell.h"
 
 int main(int argc, char *argv[])
 {
-	FILE *lal = open_lal();
+	// a compiled alias whose .lal is unchanged needs no parsing at all, but a report needs lalias itself to run it
+	if(!use_report_flag(&argc, &argv))
+	{
+		exec_compiled(argc, argv);
+	}
 
 	commands *cmds = parse_inputs(argc, argv);
-	alias_node *nodes = process_lal_file(lal);
+	// print_commands(cmds);
+
+	if(use_index_flags(cmds))
+	{
+		free_commands(cmds);
+
+		return 0;
+	}
+
+	alias_node *nodes = NULL;
+	enum error_code e;
+	FILE *lal = NULL;
+
+	// running an alias never writes the .lal, so it is read through a plain descriptor without setting up a FILE
+	int fd = cmds->sub_cmds[0].type == INPUT ? open(".lal", O_RDONLY | O_CLOEXEC) : -1;
+
+	if(fd >= 0)
+	{
+		// a sorted .lal lets the one alias be found without parsing the rest, but a compile cache needs them all
+		if(compile_cache_exists())
+		{
+			e = process_lal_fd(fd, &nodes);
+		}
+		else 
+		{
+			e = process_lal_alias_fd(fd, cmds->sub_cmds[0].contents, &nodes);
+		}
+
+		close(fd);
+	}
+	else 
+	{
+		lal = open_lal();
+
+		if(!lal)
+		{
+			lal_error(ERROR_NO_LAL);
+		}
+
+		e = process_lal_file(lal, &nodes);
+	}
+
+	if(e != ERROR_NONE)
+	{
+		lal_error(e);
+	}
 
 	run_command(cmds, &nodes, lal);
 
-	// free cmd
-	// free nodes
-	
+	free_commands(cmds);
+	free_nodes(nodes);
 
-	fclose(lal);
+	if(lal)
+	{
+		fclose(lal);
+	}
 
 	// print_nodes(nodes);
 
@@ -0,0 +1,930 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "lalias.h"
+#include "exec.h"
+#include "shell.h"
+
+#define COMPILE_SUFFIX ".sh"
+#define COMPILE_STAMP_MAX 64
+// bumped whenever the same alias compiles to a script that behaves differently
+#define COMPILE_FORMAT "2"
+
+// a positional parameter as one word
+static int append_param(char_v *out, int arg_n, enum shell_kind kind)
+{
+	char param[32];
+
+	if(kind == SHELL_FISH)
+	{
+		snprintf(param, sizeof(param), "\"$argv[%d]\"", arg_n + 1);
+	}
+	else 
+	{
+		snprintf(param, sizeof(param), "\"${%d}\"", arg_n + 1);
+	}
+
+	return char_v_append_str(out, param);
+}
+
+// text inside the double quotes of an eval, where fish only treats \, " and $ specially and sh also `
+static int append_eval_text(char_v *out, char_v *text, enum shell_kind kind)
+{
+	const char *special = kind == SHELL_FISH ? "\\\"$" : "\\\"$`";
+	int ok = 1;
+
+	for(size_t c = 0; ok && c < text->len; c++)
+	{
+		char ch = char_v_data(text)[c];
+
+		ok = (!strchr(special, ch) || char_v_append(out, '\\')) && char_v_append(out, ch);
+	}
+
+	return ok;
+}
+
+// lalias splices <<N>> into the line as raw text before the shell parses it, so a line with any goes through eval to be split the same way
+enum error_code shell_append_line(char_v *out, alias_node *node, int *i, enum shell_kind kind)
+{
+	int spliced = 0;
+
+	for(int k = *i; k < node->components_len && node->components[k].type != LAL_END_LINE; k++)
+	{
+		spliced = spliced || node->components[k].type == LAL_ARG;
+	}
+
+	if(spliced && !char_v_append_str(out, "eval \""))
+	{
+		return ERROR_FAILED_RESIZE;
+	}
+
+	for(; *i < node->components_len && node->components[*i].type != LAL_END_LINE; (*i)++)
+	{
+		struct alias_components *component = &node->components[*i];
+		int ok = 1;
+
+		if(component->type == LAL_PLAIN)
+		{
+			ok = spliced ? append_eval_text(out, &component->contents, kind) : char_v_append_char_v(out, &component->contents);
+		}
+		else if(component->type == LAL_ARG)
+		{
+			int arg_n = nn_int_from_str(char_v_data(&component->contents), component->contents.len);
+
+			if(arg_n < 0)
+			{
+				return ERROR_INSUFFICIENT_INPUTS;
+			}
+
+			char param[32];
+
+			snprintf(param, sizeof(param), kind == SHELL_FISH ? "$argv[%d]" : "${%d}", arg_n + 1);
+			ok = char_v_append_str(out, param);
+		}
+
+		if(!ok)
+		{
+			return ERROR_FAILED_RESIZE;
+		}
+	}
+
+	if(spliced && !char_v_append(out, '"'))
+	{
+		return ERROR_FAILED_RESIZE;
+	}
+
+	return ERROR_NONE;
+}
+
+int shell_n_args(alias_node *node)
+{
+	int n_args = 0;
+
+	for(int i = 0; i < node->components_len; i++)
+	{
+		char *contents = char_v_data(&node->components[i].contents);
+		size_t len = node->components[i].contents.len;
+
+		if(node->components[i].type == LAL_ARG)
+		{
+			int arg_n = nn_int_from_str(contents, len);
+
+			if(arg_n < 0)
+			{
+				return -1;
+			}
+
+			if(arg_n + 1 > n_args)
+			{
+				n_args = arg_n + 1;
+			}
+		}
+		else if(node->components[i].type == LAL_GUARD)
+		{
+			// operands were checked by parse_guard, so every << opens a number
+			for(size_t c = 0; c + 1 < len; c++)
+			{
+				if(contents[c] == '<' && contents[c + 1] == '<')
+				{
+					int arg_n = atoi(contents + c + 2);
+
+					n_args = arg_n + 1 > n_args ? arg_n + 1 : n_args;
+				}
+			}
+		}
+	}
+
+	return n_args;
+}
+
+int shell_native(alias_node *node)
+{
+	for(int i = 0; i < node->components_len; i++)
+	{
+		if(node->components[i].type == LAL_DIRECTIVE)
+		{
+			return 0;
+		}
+	}
+
+	return shell_n_args(node) >= 0;
+}
+
+int shell_compilable(alias_node *node)
+{
+	char *name = char_v_data(&node->name);
+
+	if(node->name.len == 0 || name[0] == '.' || memchr(name, '/', node->name.len) || memchr(name, '\0', node->name.len))
+	{
+		return 0;
+	}
+
+	return shell_native(node);
+}
+
+static uint64_t hash_bytes(uint64_t h, const char *data, size_t len)
+{
+	for(size_t i = 0; i < len; i++)
+	{
+		h ^= (unsigned char)data[i];
+		h *= 1099511628211ULL;
+	}
+
+	return h;
+}
+
+uint64_t shell_alias_hash(alias_node *node)
+{
+	// the format goes in too, so scripts an older lalias wrote are not kept
+	uint64_t h = hash_bytes(14695981039346656037ULL, COMPILE_FORMAT, strlen(COMPILE_FORMAT));
+
+	h = hash_bytes(h, char_v_data(&node->name), node->name.len);
+
+	for(int i = 0; i < node->components_len; i++)
+	{
+		char type = (char)node->components[i].type;
+
+		h = hash_bytes(h, &type, 1);
+		h = hash_bytes(h, char_v_data(&node->components[i].contents), node->components[i].contents.len);
+	}
+
+	return h;
+}
+
+static int script_path(char *path, int size, const char *name, size_t len)
+{
+	if(len > (size_t)size)
+	{
+		return 0;
+	}
+
+	int n = snprintf(path, size, COMPILE_DIR "/%.*s" COMPILE_SUFFIX, (int)len, name);
+
+	return n > 0 && n < size;
+}
+
+static int script_current(const char *path, const char *header)
+{
+	FILE *script = fopen(path, "rb");
+
+	if(!script)
+	{
+		return 0;
+	}
+
+	char line[COMPILE_STAMP_MAX];
+	int current = fgets(line, sizeof(line), script) && fgets(line, sizeof(line), script) && strcmp(line, header) == 0;
+
+	fclose(script);
+
+	return current;
+}
+
+static int blank_since(char_v *out, size_t start)
+{
+	for(size_t c = start; c < out->len; c++)
+	{
+		if(!strchr(" \t\n", char_v_data(out)[c]))
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+// fails the same way lalias does when too few arguments are given
+static int append_args_check(char_v *out, int n_args, enum shell_kind kind, const char *indent, const char *leave)
+{
+	if(n_args == 0)
+	{
+		return 1;
+	}
+
+	char check[256];
+	const char *message = lal_strerror(ERROR_INSUFFICIENT_INPUTS);
+
+	if(kind == SHELL_FISH)
+	{
+		snprintf(check, sizeof(check), "%sif test (count $argv) -lt %d\n%s\techo 'ERROR: %s' >&2\n%s\t%s 1\n%send\n", indent, n_args, indent, message, indent, leave, indent);
+	}
+	else 
+	{
+		snprintf(check, sizeof(check), "%sif [ $# -lt %d ]; then\n%s\techo 'ERROR: %s' >&2\n%s\t%s 1\n%sfi\n", indent, n_args, indent, message, indent, leave, indent);
+	}
+
+	return char_v_append_str(out, check);
+}
+
+// literal text is quoted, <<N>> becomes a positional parameter
+static int append_operand(char_v *out, arg_v operand, enum shell_kind kind)
+{
+	int ok = 1;
+	size_t start = 0;
+
+	for(size_t c = 0; ok && c <= operand.len; c++)
+	{
+		if(c < operand.len && !(operand.data[c] == '<' && c + 1 < operand.len && operand.data[c + 1] == '<'))
+		{
+			continue;
+		}
+
+		arg_v literal = { operand.data + start, c - start };
+
+		if(literal.len > 0)
+		{
+			ok = char_v_append_quoted(out, literal);
+		}
+
+		if(c < operand.len)
+		{
+			ok = ok && append_param(out, atoi(operand.data + c + 2), kind);
+
+			c = (size_t)((char *)memchr(operand.data + c, '>', operand.len - c) - operand.data) + 1;
+			start = c + 1;
+		}
+	}
+
+	return ok;
+}
+
+static int append_guard(char_v *out, struct guard *guard, enum shell_kind kind)
+{
+	int fish = kind == SHELL_FISH;
+	int ok = !guard->negate || char_v_append_str(out, fish ? "not " : "! ");
+	arg_v name = guard->operands[0];
+	const char *equals = NULL;
+
+	switch (guard->kind)
+	{
+		case GUARD_EXISTS:
+			ok = ok && char_v_append_str(out, fish ? "test -e " : "[ -e ") && append_operand(out, guard->operands[0], kind);
+			ok = ok && char_v_append_str(out, fish ? "" : " ]");
+			break;
+		case GUARD_NEWER:
+			// fish's own test has no -nt
+			ok = ok && char_v_append_str(out, fish ? "command test " : "[ ") && append_operand(out, guard->operands[0], kind);
+			ok = ok && char_v_append_str(out, " -nt ") && append_operand(out, guard->operands[1], kind) && char_v_append_str(out, fish ? "" : " ]");
+			break;
+		case GUARD_ENV:
+			equals = memchr(name.data, '=', name.len);
+			name.len = equals ? (size_t)(equals - name.data) : name.len;
+
+			if(fish)
+			{
+				ok = ok && char_v_append_str(out, equals ? "begin; set -q " : "set -q ") && char_v_append_arg_v(out, name);
+			}
+			else 
+			{
+				ok = ok && char_v_append_str(out, equals ? "{ [ -n \"${" : "[ -n \"${") && char_v_append_arg_v(out, name) && char_v_append_str(out, "+x}\" ]");
+			}
+
+			if(equals)
+			{
+				arg_v value = { equals + 1, guard->operands[0].data + guard->operands[0].len - equals - 1 };
+
+				ok = ok && char_v_append_str(out, fish ? "; and test \"$" : " && [ \"$") && char_v_append_arg_v(out, name) && char_v_append_str(out, "\" = ");
+				ok = ok && (value.len == 0 ? char_v_append_str(out, "''") : append_operand(out, value, kind)) && char_v_append_str(out, fish ? "; end" : " ]; }");
+			}
+			break;
+		case GUARD_OK:
+			ok = ok && char_v_append_str(out, fish ? "test $__lalias_status -eq 0" : "[ \"$__lalias_status\" -eq 0 ]");
+			break;
+		case GUARD_FAIL:
+			ok = ok && char_v_append_str(out, fish ? "test $__lalias_status -ne 0" : "[ \"$__lalias_status\" -ne 0 ]");
+			break;
+		case GUARD_STATUS:
+			ok = ok && char_v_append_str(out, fish ? "test $__lalias_status -eq " : "[ \"$__lalias_status\" -eq ") && char_v_append_arg_v(out, guard->operands[0]);
+			ok = ok && char_v_append_str(out, fish ? "" : " ]");
+			break;
+	}
+
+	return ok;
+}
+
+// the guards of the line whose first component is at i joined into one condition, *n_guards of them
+static enum error_code append_guards(char_v *out, alias_node *node, int i, enum shell_kind kind, int *n_guards)
+{
+	*n_guards = 0;
+
+	for(; i < node->components_len && node->components[i].type != LAL_END_LINE; i++)
+	{
+		struct guard guard;
+		char_v *contents = &node->components[i].contents;
+
+		if(node->components[i].type != LAL_GUARD)
+		{
+			continue;
+		}
+
+		if(parse_guard(char_v_data(contents), contents->len, &guard) != ERROR_NONE)
+		{
+			return ERROR_BAD_GUARD;
+		}
+
+		int ok = (*n_guards == 0 || char_v_append_str(out, kind == SHELL_FISH ? "; and " : " && ")) && append_guard(out, &guard, kind);
+
+		if(!ok)
+		{
+			return ERROR_FAILED_RESIZE;
+		}
+
+		(*n_guards)++;
+	}
+
+	return ERROR_NONE;
+}
+
+// whether any line looks at the status of the one before
+static int tracks_status(alias_node *node)
+{
+	for(int i = 0; i < node->components_len; i++)
+	{
+		char *contents = char_v_data(&node->components[i].contents);
+		struct guard guard;
+
+		if(node->components[i].type == LAL_GUARD && parse_guard(contents, node->components[i].contents.len, &guard) == ERROR_NONE && guard.kind >= GUARD_OK)
+		{
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+// one alias line as a statement, guarded lines inside an if; isolated lines get their own subshell as under sh -c
+static enum error_code emit_statement(char_v *out, alias_node *node, int *i, enum shell_kind kind, const char *indent, int isolate, int track)
+{
+	int fish = kind == SHELL_FISH;
+	int n_guards = 0;
+	int ok = char_v_append_str(out, indent) && char_v_append_str(out, "if ");
+	size_t guarded = out->len;
+
+	enum error_code e = append_guards(out, node, *i, kind, &n_guards);
+
+	if(e != ERROR_NONE)
+	{
+		return e;
+	}
+
+	if(n_guards == 0)
+	{
+		out->len = guarded - strlen("if ") - strlen(indent);
+	}
+	else 
+	{
+		ok = ok && char_v_append_str(out, fish ? "\n" : "; then\n");
+	}
+
+	const char *inner = n_guards > 0 ? "\t" : "";
+
+	ok = ok && char_v_append_str(out, indent) && char_v_append_str(out, inner) && (!isolate || char_v_append_str(out, "(\n"));
+
+	size_t start = out->len;
+
+	e = shell_append_line(out, node, i, kind);
+
+	if(e != ERROR_NONE)
+	{
+		return e;
+	}
+
+	// an empty subshell or if is a syntax error
+	if(blank_since(out, start))
+	{
+		out->len = start;
+		ok = ok && char_v_append_str(out, fish ? "true" : ":");
+	}
+
+	ok = ok && char_v_append(out, '\n') && (!isolate || char_v_append_str(out, ")\n"));
+
+	if(track)
+	{
+		ok = ok && char_v_append_str(out, indent) && char_v_append_str(out, inner) && char_v_append_str(out, fish ? "set __lalias_status $status\n" : "__lalias_status=$?\n");
+	}
+
+	if(n_guards > 0)
+	{
+		ok = ok && char_v_append_str(out, indent) && char_v_append_str(out, fish ? "end\n" : "fi\n");
+	}
+
+	return ok ? ERROR_NONE : ERROR_FAILED_RESIZE;
+}
+
+// judged on the template with a plain word for every placeholder, since arguments are not known yet
+static int builtin_template(alias_node *node, int i)
+{
+	char_v *text = init_char_v();
+	int ok = text != NULL;
+
+	for(; ok && i < node->components_len && node->components[i].type != LAL_END_LINE; i++)
+	{
+		if(node->components[i].type == LAL_PLAIN)
+		{
+			ok = char_v_append_char_v(text, &node->components[i].contents);
+		}
+		else if(node->components[i].type == LAL_ARG)
+		{
+			ok = char_v_append(text, 'x');
+		}
+	}
+
+	int builtin = ok && char_v_append(text, '\0') && builtin_line(char_v_data(text));
+
+	free_char_v(text);
+
+	return builtin;
+}
+
+// a fresh subshell per line keeps each line as isolated as its own sh -c, builtins stay outside so later lines inherit them
+static enum error_code emit_script(char_v *out, alias_node *node, const char *header)
+{
+	int n_args = shell_n_args(node);
+	int track = tracks_status(node);
+	int ok = char_v_append_str(out, "#!/bin/sh\n") && char_v_append_str(out, header);
+
+	ok = ok && char_v_append_str(out, "# generated by lalias --compile, edits are overwritten\n");
+	ok = ok && append_args_check(out, n_args, SHELL_SH, "", "exit");
+	ok = ok && (!track || char_v_append_str(out, "__lalias_status=0\n"));
+
+	for(int i = 0; ok && i < node->components_len; i++)
+	{
+		if(node->components[i].type == LAL_NEW_LINE)
+		{
+			i++;
+			enum error_code e = emit_statement(out, node, &i, SHELL_SH, "", !builtin_template(node, i), track);
+
+			if(e != ERROR_NONE)
+			{
+				return e;
+			}
+		}
+	}
+
+	ok = ok && char_v_append_str(out, "exit 0\n");
+
+	return ok ? ERROR_NONE : ERROR_FAILED_RESIZE;
+}
+
+static enum error_code compile_alias(alias_node *node)
+{
+	char path[PATH_MAX];
+	char tmp[PATH_MAX];
+	char header[COMPILE_STAMP_MAX];
+
+	snprintf(header, sizeof(header), COMPILE_HASH_HEADER "%016llx\n", (unsigned long long)shell_alias_hash(node));
+
+	if(!script_path(path, sizeof(path), char_v_data(&node->name), node->name.len) || snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= sizeof(tmp))
+	{
+		return ERROR_FAILED_COMPILE;
+	}
+
+	if(script_current(path, header))
+	{
+		return ERROR_NONE;
+	}
+
+	char_v *script = init_char_v();
+
+	if(!script)
+	{
+		return ERROR_FAILED_RESIZE;
+	}
+
+	enum error_code e = emit_script(script, node, header);
+
+	if(e == ERROR_NONE)
+	{
+		int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0755);
+		int ok = fd >= 0 && write(fd, char_v_data(script), script->len) == (ssize_t)script->len;
+
+		if(fd >= 0 && close(fd) != 0)
+		{
+			ok = 0;
+		}
+
+		// renamed into place so a concurrent exec never sees half a script
+		if(!ok || rename(tmp, path) != 0)
+		{
+			unlink(tmp);
+			e = ERROR_FAILED_COMPILE;
+		}
+	}
+
+	free_char_v(script);
+
+	return e;
+}
+
+// scripts of deleted, renamed or no longer compilable aliases
+static void remove_stale(alias_node *labels)
+{
+	DIR *dir = opendir(COMPILE_DIR);
+
+	if(!dir)
+	{
+		return;
+	}
+
+	struct dirent *entry;
+
+	while((entry = readdir(dir)) != NULL)
+	{
+		int len = strlen(entry->d_name) - strlen(COMPILE_SUFFIX);
+
+		if(len <= 0 || strcmp(entry->d_name + len, COMPILE_SUFFIX) != 0)
+		{
+			continue;
+		}
+
+		arg_v name = { entry->d_name, len };
+		alias_node *node = find_node(labels, name);
+
+		if(!node || !shell_compilable(node))
+		{
+			char path[PATH_MAX];
+			snprintf(path, sizeof(path), COMPILE_DIR "/%s", entry->d_name);
+			unlink(path);
+		}
+	}
+
+	closedir(dir);
+}
+
+static int format_stamp(char *stamp, int size)
+{
+	struct stat s;
+
+	if(stat(".lal", &s) != 0)
+	{
+		return 0;
+	}
+
+	return snprintf(stamp, size, "%lld %ld %lld\n", (long long)s.st_mtim.tv_sec, (long)s.st_mtim.tv_nsec, (long long)s.st_size) < size;
+}
+
+enum error_code compile_aliases(alias_node *labels)
+{
+	if(mkdir(COMPILE_DIR, 0755) != 0 && errno != EEXIST)
+	{
+		return ERROR_FAILED_COMPILE;
+	}
+
+	// stale until every script is written
+	unlink(COMPILE_STAMP);
+
+	for(alias_node *node = labels; node != NULL; node = node->next_node)
+	{
+		arg_v name = { char_v_data(&node->name), node->name.len };
+
+		// the first definition of a name wins, as in find_node
+		if(!shell_compilable(node) || find_node(labels, name) != node)
+		{
+			continue;
+		}
+
+		enum error_code e = compile_alias(node);
+
+		if(e != ERROR_NONE)
+		{
+			return e;
+		}
+	}
+
+	remove_stale(labels);
+
+	char stamp[COMPILE_STAMP_MAX];
+
+	if(!format_stamp(stamp, sizeof(stamp)))
+	{
+		return ERROR_FAILED_COMPILE;
+	}
+
+	FILE *file = fopen(COMPILE_STAMP, "wb");
+
+	if(!file)
+	{
+		return ERROR_FAILED_COMPILE;
+	}
+
+	int ok = fputs(stamp, file) >= 0;
+
+	if(fclose(file) != 0 || !ok)
+	{
+		unlink(COMPILE_STAMP);
+		return ERROR_FAILED_COMPILE;
+	}
+
+	return ERROR_NONE;
+}
+
+int compile_cache_exists(void)
+{
+	struct stat s;
+
+	return stat(COMPILE_DIR, &s) == 0 && S_ISDIR(s.st_mode);
+}
+
+int compile_cache_current(void)
+{
+	char expected[COMPILE_STAMP_MAX];
+	char stamp[COMPILE_STAMP_MAX];
+
+	int fd = open(COMPILE_STAMP, O_RDONLY);
+
+	if(fd < 0)
+	{
+		return 0;
+	}
+
+	ssize_t n = read(fd, stamp, sizeof(stamp) - 1);
+	close(fd);
+
+	if(n <= 0 || !format_stamp(expected, sizeof(expected)))
+	{
+		return 0;
+	}
+
+	stamp[n] = '\0';
+
+	return strcmp(stamp, expected) == 0;
+}
+
+void exec_compiled(int argc, char *argv[])
+{
+	if(argc < 2)
+	{
+		return;
+	}
+
+	char *name = argv[1];
+	char path[PATH_MAX];
+
+	if(name[0] == '-' || name[0] == '.' || strchr(name, '/') || !compile_cache_current())
+	{
+		return;
+	}
+
+	if(!script_path(path, sizeof(path), name, strlen(name)))
+	{
+		return;
+	}
+
+	argv[1] = path;
+	execv(path, argv + 1);
+	argv[1] = name;
+}
+
+int shell_kind_from_str(const char *str, size_t len, enum shell_kind *kind)
+{
+	if(exact_match(str, len, "bash", strlen("bash")))
+	{
+		*kind = SHELL_BASH;
+	}
+	else if(exact_match(str, len, "zsh", strlen("zsh")))
+	{
+		*kind = SHELL_ZSH;
+	}
+	else if(exact_match(str, len, "fish", strlen("fish")))
+	{
+		*kind = SHELL_FISH;
+	}
+	else 
+	{
+		return 0;
+	}
+
+	return 1;
+}
+
+// names every shell takes as a function name without quoting
+static int function_name_ok(alias_node *node)
+{
+	char *name = char_v_data(&node->name);
+
+	if(node->name.len == 0 || name[0] == '-')
+	{
+		return 0;
+	}
+
+	for(size_t c = 0; c < node->name.len; c++)
+	{
+		if(!((name[c] >= 'a' && name[c] <= 'z') || (name[c] >= 'A' && name[c] <= 'Z') || (name[c] >= '0' && name[c] <= '9') || strchr("_-.+@%,", name[c])))
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+// lines run in the calling shell itself, so cd and export stick
+static enum error_code emit_function(char_v *out, alias_node *node, enum shell_kind kind, arg_v dir)
+{
+	int fish = kind == SHELL_FISH;
+	int ok = char_v_append_str(out, fish ? "function " : "") && char_v_append_char_v(out, &node->name) && char_v_append_str(out, fish ? "\n" : "() {\n");
+
+	if(!shell_native(node))
+	{
+		// directives need the supervisor, so these still go through lalias
+		ok = ok && char_v_append_str(out, fish ? "\tcommand sh -c 'cd \"$1\" && shift && exec lalias \"$@\"' lalias " : "\t(cd ");
+		ok = ok && char_v_append_quoted(out, dir) && char_v_append_str(out, fish ? " " : " && command lalias ");
+		ok = ok && char_v_append_char_v(out, &node->name) && char_v_append_str(out, fish ? " $argv\n" : " \"$@\")\n");
+	}
+	else 
+	{
+		int track = tracks_status(node);
+
+		ok = ok && append_args_check(out, shell_n_args(node), kind, "\t", "return");
+		ok = ok && (!track || char_v_append_str(out, fish ? "\tset -l __lalias_status 0\n" : "\tlocal __lalias_status=0\n"));
+
+		size_t body = out->len;
+
+		for(int i = 0; ok && i < node->components_len; i++)
+		{
+			if(node->components[i].type == LAL_NEW_LINE)
+			{
+				i++;
+				enum error_code e = emit_statement(out, node, &i, kind, "\t", FALSE, track);
+
+				if(e != ERROR_NONE)
+				{
+					return e;
+				}
+			}
+		}
+
+		// an empty body is a syntax error in sh
+		if(ok && out->len == body && !fish)
+		{
+			ok = char_v_append_str(out, "\t:\n");
+		}
+	}
+
+	ok = ok && char_v_append_str(out, fish ? "end\n" : "}\n");
+
+	return ok ? ERROR_NONE : ERROR_FAILED_RESIZE;
+}
+
+// the prompt hook tests the .lal against a per-shell stamp with the builtin test, so nothing forks until it changes
+static int emit_sh_prelude(char_v *out, enum shell_kind kind, arg_v dir)
+{
+	const char *split = kind == SHELL_ZSH ? "${=__lalias_functions}" : "$__lalias_functions";
+	char unset[128];
+
+	snprintf(unset, sizeof(unset), "for __lalias_f in %s; do unset -f \"$__lalias_f\"; done\n", split);
+
+	int ok = char_v_append_str(out, "__lalias_dir=") && char_v_append_quoted(out, dir) && char_v_append(out, '\n');
+
+	ok = ok && char_v_append_str(out, "__lalias_stamp=\"${XDG_RUNTIME_DIR:-${TMPDIR:-/tmp}}/lalias-$$.stamp\"\n");
+	ok = ok && char_v_append_str(out, "command touch -r \"$__lalias_dir/.lal\" \"$__lalias_stamp\" 2>/dev/null\n");
+	ok = ok && char_v_append_str(out, unset);
+
+	return ok;
+}
+
+static int emit_sh_hook(char_v *out, enum shell_kind kind)
+{
+	const char *export = kind == SHELL_ZSH ? "zsh" : "bash";
+	char refresh[512];
+
+	snprintf(refresh, sizeof(refresh),
+		"__lalias_refresh() {\n"
+		"\tif [ \"$__lalias_dir/.lal\" -nt \"$__lalias_stamp\" ] || [ \"$__lalias_dir/.lal\" -ot \"$__lalias_stamp\" ]; then\n"
+		"\t\teval \"$(cd \"$__lalias_dir\" && command lalias --export %s)\"\n"
+		"\tfi\n"
+		"}\n", export);
+
+	int ok = char_v_append_str(out, refresh);
+
+	if(kind == SHELL_ZSH)
+	{
+		ok = ok && char_v_append_str(out, "autoload -Uz add-zsh-hook\nadd-zsh-hook precmd __lalias_refresh\n");
+	}
+	else 
+	{
+		ok = ok && char_v_append_str(out, "case \";$PROMPT_COMMAND;\" in\n\t*\";__lalias_refresh;\"*) ;;\n\t*) PROMPT_COMMAND=\"__lalias_refresh${PROMPT_COMMAND:+;$PROMPT_COMMAND}\" ;;\nesac\n");
+	}
+
+	return ok;
+}
+
+// fish has path mtime as a builtin, so the hook just remembers the last one it saw
+static int emit_fish_prelude(char_v *out, arg_v dir)
+{
+	int ok = char_v_append_str(out, "set -g __lalias_dir ") && char_v_append_quoted(out, dir) && char_v_append(out, '\n');
+
+	ok = ok && char_v_append_str(out, "set -g __lalias_mtime (path mtime $__lalias_dir/.lal 2>/dev/null)\n");
+	ok = ok && char_v_append_str(out, "for __lalias_f in $__lalias_functions\n\tfunctions -e $__lalias_f\nend\n");
+
+	return ok;
+}
+
+static int emit_fish_hook(char_v *out)
+{
+	return char_v_append_str(out,
+		"function __lalias_refresh --on-event fish_prompt\n"
+		"\tset -l mtime (path mtime $__lalias_dir/.lal 2>/dev/null)\n"
+		"\tif test \"$mtime\" != \"$__lalias_mtime\"\n"
+		"\t\tset -l here $PWD\n"
+		"\t\tbuiltin cd $__lalias_dir\n"
+		"\t\tand command lalias --export fish | source\n"
+		"\t\tbuiltin cd $here\n"
+		"\tend\n"
+		"end\n");
+}
+
+enum error_code export_aliases(char_v *out, alias_node *labels, enum shell_kind kind, const char *dir)
+{
+	arg_v dir_arg = { dir, strlen(dir) };
+	int fish = kind == SHELL_FISH;
+	int ok = char_v_append_str(out, "# generated by lalias --export, load with eval or source\n");
+
+	ok = ok && (fish ? emit_fish_prelude(out, dir_arg) : emit_sh_prelude(out, kind, dir_arg));
+	ok = ok && char_v_append_str(out, fish ? "set -g __lalias_functions " : "__lalias_functions='");
+
+	int first = 1;
+
+	for(alias_node *node = labels; ok && node != NULL; node = node->next_node)
+	{
+		arg_v name = { char_v_data(&node->name), node->name.len };
+
+		if(function_name_ok(node) && find_node(labels, name) == node)
+		{
+			ok = (first || char_v_append(out, ' ')) && char_v_append_char_v(out, &node->name);
+			first = 0;
+		}
+	}
+
+	ok = ok && char_v_append_str(out, fish ? "\n" : "'\n");
+
+	for(alias_node *node = labels; ok && node != NULL; node = node->next_node)
+	{
+		arg_v name = { char_v_data(&node->name), node->name.len };
+
+		// the first definition of a name wins, as in find_node
+		if(!function_name_ok(node) || find_node(labels, name) != node)
+		{
+			continue;
+		}
+
+		enum error_code e = emit_function(out, node, kind, dir_arg);
+
+		if(e != ERROR_NONE)
+		{
+			return e;
+		}
+	}
+
+	ok = ok && (fish ? emit_fish_hook(out) : emit_sh_hook(out, kind));
+
+	return ok ? ERROR_NONE : ERROR_FAILED_RESIZE;
+}
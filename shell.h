@@ -0,0 +1,46 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "liblalias.h"
+
+#define COMPILE_DIR ".lal_cache"
+#define COMPILE_STAMP COMPILE_DIR "/stamp"
+#define COMPILE_HASH_HEADER "# lalias-hash: "
+
+struct char_v;
+struct alias_node;
+
+enum shell_kind
+{
+	SHELL_SH,
+	SHELL_BASH,
+	SHELL_ZSH,
+	SHELL_FISH
+};
+
+// appends the line whose first component is at *i as shell text with <<N>> spliced in unquoted as lalias does, leaving *i on its LAL_END_LINE
+enum error_code shell_append_line(struct char_v *out, struct alias_node *node, int *i, enum shell_kind kind);
+
+// the number of arguments the alias needs, -1 if a placeholder is not a number
+int shell_n_args(struct alias_node *node);
+
+// directives need the supervisor, so only aliases without them can run as plain shell
+int shell_native(struct alias_node *node);
+
+// shell_native, and the name must be usable as a file name
+int shell_compilable(struct alias_node *node);
+uint64_t shell_alias_hash(struct alias_node *node);
+
+enum error_code compile_aliases(struct alias_node *labels);
+int compile_cache_exists(void);
+int compile_cache_current(void);
+
+// bash, zsh or fish
+int shell_kind_from_str(const char *str, size_t len, enum shell_kind *kind);
+
+// function definitions for every alias, plus a prompt hook that reloads them when dir/.lal changes
+enum error_code export_aliases(struct char_v *out, struct alias_node *labels, enum shell_kind kind, const char *dir);
+
+// only returns if there is no current script for argv[1]; the script runs without lalias, so the alias is not
+// recorded in .lal_stats, which --compile and --stats both warn about, and main skips it for --mem-report
+void exec_compiled(int argc, char *argv[]);
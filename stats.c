@@ -0,0 +1,375 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "stats.h"
+#include "lal_alloc.h"
+
+#define STATS_MAGIC "LALSTAT1"
+#define STATS_SUB_BUCKETS 4
+
+struct stats_header
+{
+	char magic[8];
+	uint32_t record_size;
+	uint32_t reserved;
+};
+
+static uint64_t hash_name(const char *name, size_t len)
+{
+	uint64_t h = 14695981039346656037ULL;
+
+	for(size_t i = 0; i < len; i++)
+	{
+		h ^= (unsigned char)name[i];
+		h *= 1099511628211ULL;
+	}
+
+	return h;
+}
+
+// log-linear buckets: exact below 4us, then 4 sub-buckets per power of two
+static int bucket_of(uint64_t us)
+{
+	if(us < STATS_SUB_BUCKETS)
+	{
+		return us;
+	}
+
+	int e = 63 - __builtin_clzll(us);
+	int sub = (us >> (e - 2)) & (STATS_SUB_BUCKETS - 1);
+	int b = STATS_SUB_BUCKETS * (e - 1) + sub;
+
+	return b < STATS_BUCKETS ? b : STATS_BUCKETS - 1;
+}
+
+static uint64_t bucket_low(int b)
+{
+	if(b < STATS_SUB_BUCKETS)
+	{
+		return b;
+	}
+
+	int e = b / STATS_SUB_BUCKETS + 1;
+	int sub = b % STATS_SUB_BUCKETS;
+
+	return (uint64_t)(STATS_SUB_BUCKETS + sub) << (e - 2);
+}
+
+static uint64_t bucket_mid(int b)
+{
+	if(b < STATS_SUB_BUCKETS)
+	{
+		return b;
+	}
+
+	uint64_t low = bucket_low(b);
+	uint64_t width = (uint64_t)1 << (b / STATS_SUB_BUCKETS - 1);
+
+	return low + width / 2;
+}
+
+static int open_stats(int flags)
+{
+	int fd = open(STATS_FILE, flags | O_CLOEXEC, 0644);
+
+	if(fd < 0)
+	{
+		return -1;
+	}
+
+	if(flock(fd, (flags & O_RDWR) ? LOCK_EX : LOCK_SH) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+
+	struct stat s;
+
+	if(fstat(fd, &s) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+
+	struct stats_header header;
+
+	if(s.st_size == 0 && (flags & O_RDWR))
+	{
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, STATS_MAGIC, sizeof(header.magic));
+		header.record_size = sizeof(struct stats_record);
+
+		if(pwrite(fd, &header, sizeof(header), 0) != sizeof(header))
+		{
+			close(fd);
+			return -1;
+		}
+
+		return fd;
+	}
+
+	if(pread(fd, &header, sizeof(header), 0) != sizeof(header)
+		|| memcmp(header.magic, STATS_MAGIC, sizeof(header.magic)) != 0
+		|| header.record_size != sizeof(struct stats_record))
+	{
+		close(fd);
+		errno = EINVAL;
+		return -1;
+	}
+
+	return fd;
+}
+
+static struct stats_record *read_records(int fd, int *n_records)
+{
+	struct stat s;
+
+	if(fstat(fd, &s) != 0)
+	{
+		return NULL;
+	}
+
+	int n = (s.st_size - sizeof(struct stats_header)) / sizeof(struct stats_record);
+	struct stats_record *records = lal_malloc(LAL_MEM_STATS, sizeof(struct stats_record) * (n + 1));
+
+	if(!records)
+	{
+		return NULL;
+	}
+
+	size_t bytes = sizeof(struct stats_record) * n;
+
+	if(n > 0 && pread(fd, records, bytes, sizeof(struct stats_header)) != (ssize_t)bytes)
+	{
+		lal_free(LAL_MEM_STATS, records);
+		return NULL;
+	}
+
+	*n_records = n;
+
+	return records;
+}
+
+static void add_sample(struct stats_record *record, struct line_result *result, int64_t wall_us)
+{
+	record->calls++;
+	record->failures += line_failed(result) ? 1 : 0;
+	record->wall_us_total += wall_us;
+	record->user_us_total += result->user_us;
+	record->sys_us_total += result->sys_us;
+	record->wall_hist[bucket_of(wall_us)]++;
+
+	if((uint64_t)wall_us > record->wall_us_max)
+	{
+		record->wall_us_max = wall_us;
+	}
+}
+
+static int update_record(int fd, struct stats_record **records, int *n_records, uint64_t hash, const char *name, size_t name_len, int line, struct line_result *result, int64_t wall_us)
+{
+	int r = 0;
+
+	while(r < *n_records && ((*records)[r].name_hash != hash || (*records)[r].line != line))
+	{
+		r++;
+	}
+
+	if(r == *n_records)
+	{
+		struct stats_record *grown = lal_realloc(LAL_MEM_STATS, *records, sizeof(struct stats_record) * (*n_records + 1));
+
+		if(!grown)
+		{
+			return 0;
+		}
+
+		*records = grown;
+		(*n_records)++;
+
+		struct stats_record *fresh = &(*records)[r];
+		memset(fresh, 0, sizeof(struct stats_record));
+
+		fresh->name_hash = hash;
+		fresh->line = line;
+		memcpy(fresh->name, name, name_len < STATS_NAME_MAX ? name_len : STATS_NAME_MAX - 1);
+	}
+
+	add_sample(&(*records)[r], result, wall_us);
+
+	off_t offset = sizeof(struct stats_header) + (off_t)r * sizeof(struct stats_record);
+
+	return pwrite(fd, &(*records)[r], sizeof(struct stats_record), offset) == sizeof(struct stats_record);
+}
+
+int stats_record_invocation(const char *name, size_t name_len, struct line_result *lines, int n_lines, int64_t wall_us)
+{
+	int fd = open_stats(O_RDWR | O_CREAT);
+
+	if(fd < 0)
+	{
+		return 0;
+	}
+
+	int n_records = 0;
+	struct stats_record *records = read_records(fd, &n_records);
+
+	if(!records)
+	{
+		close(fd);
+		return 0;
+	}
+
+	uint64_t hash = hash_name(name, name_len);
+	struct line_result whole = { 0, wall_us, 0, 0 };
+	int ok = 1;
+
+	for(int l = 0; l < n_lines; l++)
+	{
+		whole.user_us += lines[l].user_us;
+		whole.sys_us += lines[l].sys_us;
+
+		if(line_failed(&lines[l]))
+		{
+			whole.status = lines[l].status;
+		}
+
+		ok &= update_record(fd, &records, &n_records, hash, name, name_len, lines[l].line, &lines[l], lines[l].wall_us);
+	}
+
+	ok &= update_record(fd, &records, &n_records, hash, name, name_len, STATS_WHOLE_ALIAS, &whole, wall_us);
+
+	lal_free(LAL_MEM_STATS, records);
+	close(fd);
+
+	return ok;
+}
+
+static uint64_t percentile(struct stats_record *record, double p)
+{
+	uint64_t target = (uint64_t)(p * record->calls + 0.999999);
+	uint64_t seen = 0;
+
+	if(target == 0)
+	{
+		target = 1;
+	}
+
+	for(int b = 0; b < STATS_BUCKETS; b++)
+	{
+		seen += record->wall_hist[b];
+
+		if(seen >= target)
+		{
+			uint64_t mid = bucket_mid(b);
+
+			return mid < record->wall_us_max ? mid : record->wall_us_max;
+		}
+	}
+
+	return record->wall_us_max;
+}
+
+static void format_us(char *buf, size_t size, uint64_t us)
+{
+	if(us < 1000)
+	{
+		snprintf(buf, size, "%lluus", (unsigned long long)us);
+	}
+	else if(us < 1000000)
+	{
+		snprintf(buf, size, "%.1fms", us / 1000.0);
+	}
+	else
+	{
+		snprintf(buf, size, "%.2fs", us / 1000000.0);
+	}
+}
+
+static int compare_records(const void *a, const void *b)
+{
+	const struct stats_record *r1 = a;
+	const struct stats_record *r2 = b;
+	int c = strncmp(r1->name, r2->name, STATS_NAME_MAX);
+
+	if(c != 0)
+	{
+		return c;
+	}
+
+	return (r1->line > r2->line) - (r1->line < r2->line);
+}
+
+int stats_print(const char *name, size_t name_len)
+{
+	int fd = open_stats(O_RDONLY);
+
+	if(fd < 0)
+	{
+		if(errno == ENOENT)
+		{
+			printf("No stats recorded.\n");
+			return 1;
+		}
+
+		return 0;
+	}
+
+	int n_records = 0;
+	struct stats_record *records = read_records(fd, &n_records);
+
+	close(fd);
+
+	if(!records)
+	{
+		return 0;
+	}
+
+	qsort(records, n_records, sizeof(struct stats_record), compare_records);
+
+	uint64_t hash = name ? hash_name(name, name_len) : 0;
+
+	printf("%-24s %5s %8s %9s %9s %9s %9s %6s %9s %9s\n", "ALIAS", "LINE", "CALLS", "P50", "P95", "P99", "MAX", "FAIL%", "USER", "SYS");
+
+	for(int r = 0; r < n_records; r++)
+	{
+		struct stats_record *record = &records[r];
+
+		if((name && record->name_hash != hash) || record->calls == 0)
+		{
+			continue;
+		}
+
+		char line[16];
+		char p50[16], p95[16], p99[16], max[16], user[16], sys[16];
+
+		if(record->line == STATS_WHOLE_ALIAS)
+		{
+			snprintf(line, sizeof(line), "*");
+		}
+		else
+		{
+			snprintf(line, sizeof(line), "%d", record->line);
+		}
+
+		format_us(p50, sizeof(p50), percentile(record, 0.50));
+		format_us(p95, sizeof(p95), percentile(record, 0.95));
+		format_us(p99, sizeof(p99), percentile(record, 0.99));
+		format_us(max, sizeof(max), record->wall_us_max);
+		format_us(user, sizeof(user), record->user_us_total / record->calls);
+		format_us(sys, sizeof(sys), record->sys_us_total / record->calls);
+
+		printf("%-24.*s %5s %8u %9s %9s %9s %9s %5.1f%% %9s %9s\n",
+			STATS_NAME_MAX, record->name, line, record->calls, p50, p95, p99, max,
+			100.0 * record->failures / record->calls, user, sys);
+	}
+
+	lal_free(LAL_MEM_STATS, records);
+
+	return 1;
+}
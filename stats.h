@@ -0,0 +1,28 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "exec.h"
+
+#define STATS_FILE ".lal_stats"
+#define STATS_NAME_MAX 48
+#define STATS_BUCKETS 128
+#define STATS_WHOLE_ALIAS -1
+
+// one fixed-size slot per (alias, line); line STATS_WHOLE_ALIAS holds the whole invocation
+struct stats_record
+{
+	uint64_t name_hash;
+	char name[STATS_NAME_MAX];
+	int32_t line;
+	uint32_t calls;
+	uint32_t failures;
+	uint32_t reserved;
+	uint64_t wall_us_total;
+	uint64_t user_us_total;
+	uint64_t sys_us_total;
+	uint64_t wall_us_max;
+	uint32_t wall_hist[STATS_BUCKETS];
+};
+
+int stats_record_invocation(const char *name, size_t name_len, struct line_result *lines, int n_lines, int64_t wall_us);
+int stats_print(const char *name, size_t name_len);